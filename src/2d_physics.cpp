@@ -3,15 +3,22 @@
 
 #include "sim.hpp"
 
-int main()
+// usage: 2d_physics [checkpoint]
+//
+// Starts from the given checkpoint, or from freshly spawned particles.
+int main(int argc, char** argv)
 {
 
 
     point_particle_simulator sim;
 
-    sim.spawn_particles();
-
-    sim.generate_pairs();
+    if (argc > 1) {
+        if (!sim.load_checkpoint(argv[1]))
+            return EXIT_FAILURE;
+    }
+    else {
+        sim.spawn_particles();
+    }
 
     sim.run();
 
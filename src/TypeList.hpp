@@ -70,7 +70,7 @@ namespace ListsViaTypes{
 
 	template<typename T, typename ... Ts>
 	struct Reverser< TypeList<T, Ts...> > {
-		using type = typename ConcatenateLists< typename Reverser<TypeList<Ts...>>::type, TypeList<T> >;
+		using type = ConcatenateLists< typename Reverser<TypeList<Ts...>>::type, TypeList<T> >;
 	};
 
 	template<typename T>
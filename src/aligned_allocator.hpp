@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+
+// Allocator for containers whose storage should start on a cache line (or
+// SIMD register) boundary.
+template<typename T, size_t Alignment>
+struct aligned_allocator {
+	using value_type = T;
+
+	static constexpr std::align_val_t alignment{ std::max(Alignment, alignof(T)) };
+
+	// Needed explicitly, allocator_traits can't rebind a non-type parameter.
+	template<typename U>
+	struct rebind {
+		using other = aligned_allocator<U, Alignment>;
+	};
+
+	aligned_allocator() noexcept = default;
+
+	template<typename U>
+	aligned_allocator(aligned_allocator<U, Alignment> const&) noexcept { }
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(::operator new(n * sizeof(T), alignment));
+	}
+
+	void deallocate(T* p, size_t) noexcept {
+		::operator delete(p, alignment);
+	}
+
+	template<typename U>
+	bool operator==(aligned_allocator<U, Alignment> const&) const noexcept {
+		return true;
+	}
+};
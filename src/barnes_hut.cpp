@@ -0,0 +1,215 @@
+#include "barnes_hut.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+barnes_hut_tree::barnes_hut_tree(float opening_angle) noexcept
+	: opening_angle(opening_angle) {
+}
+
+void barnes_hut_tree::set_opening_angle(float theta) noexcept {
+	opening_angle = std::max(theta, 0.f);
+}
+
+float barnes_hut_tree::get_opening_angle() const noexcept {
+	return opening_angle;
+}
+
+void barnes_hut_tree::build(particle_arrays const& particles) {
+	auto const n = particles.size;
+
+	xs.resize(n);
+	ys.resize(n);
+	masses.resize(n);
+	charges.resize(n);
+	order.resize(n);
+	nodes.clear();
+
+	if (n == 0)
+		return;
+
+	float min_x = std::numeric_limits<float>::max();
+	float min_y = std::numeric_limits<float>::max();
+	float max_x = std::numeric_limits<float>::lowest();
+	float max_y = std::numeric_limits<float>::lowest();
+
+	for (size_t i = 0; i < n; ++i) {
+		xs[i] = particles.x[i];
+		ys[i] = particles.y[i];
+		masses[i] = particles.mass[i];
+		charges[i] = particles.charge[i];
+		order[i] = i;
+
+		min_x = std::min(min_x, xs[i]);
+		min_y = std::min(min_y, ys[i]);
+		max_x = std::max(max_x, xs[i]);
+		max_y = std::max(max_y, ys[i]);
+	}
+
+	// Pad a little so particles on the far edge still fall strictly inside.
+	auto const half_width = 0.5f * std::max(max_x - min_x, max_y - min_y) * 1.001f + 1e-3f;
+
+	nodes.reserve(2 * n / leaf_capacity + 1);
+	nodes.resize(1);
+	build_node(0, 0, n, 0.5f * (min_x + max_x), 0.5f * (min_y + max_y), half_width, 0);
+}
+
+void barnes_hut_tree::build_node(size_t index, size_t begin, size_t end, float center_x, float center_y, float half_width, size_t depth) {
+	nodes[index] = node{ center_x, center_y, half_width, 0.f, center_x, center_y, 0.f, 0.f, center_x, center_y, begin, end, no_children };
+
+	float mass = 0.f, mass_x = 0.f, mass_y = 0.f;
+	float charge = 0.f, abs_charge = 0.f, charge_x = 0.f, charge_y = 0.f;
+
+	if (end - begin <= leaf_capacity or depth == max_depth) {
+		for (auto o = begin; o < end; ++o) {
+			auto const i = order[o];
+			auto const q = std::abs(charges[i]);
+
+			mass += masses[i];
+			mass_x += masses[i] * xs[i];
+			mass_y += masses[i] * ys[i];
+
+			charge += charges[i];
+			abs_charge += q;
+			charge_x += q * xs[i];
+			charge_y += q * ys[i];
+		}
+	}
+	else {
+		// Split [begin, end) into the four quadrants: left/right first, then
+		// bottom/top within each half.
+		auto const first = order.begin() + begin;
+		auto const last = order.begin() + end;
+		auto const split_x = std::partition(first, last, [&](size_t i) { return xs[i] < center_x; });
+		auto const split_lower = std::partition(first, split_x, [&](size_t i) { return ys[i] < center_y; });
+		auto const split_upper = std::partition(split_x, last, [&](size_t i) { return ys[i] < center_y; });
+
+		size_t const bounds[5] = {
+			begin,
+			static_cast<size_t>(split_lower - order.begin()),
+			static_cast<size_t>(split_x - order.begin()),
+			static_cast<size_t>(split_upper - order.begin()),
+			end
+		};
+
+		auto const quarter = 0.5f * half_width;
+		float const child_x[4] = { center_x - quarter, center_x - quarter, center_x + quarter, center_x + quarter };
+		float const child_y[4] = { center_y - quarter, center_y + quarter, center_y - quarter, center_y + quarter };
+
+		// Siblings are allocated together so a node only needs the index of
+		// its first child. nodes may reallocate below, so no references.
+		auto const first_child = nodes.size();
+		nodes.resize(first_child + 4);
+		nodes[index].first_child = first_child;
+
+		for (auto c = 0; c < 4; ++c) {
+			build_node(first_child + c, bounds[c], bounds[c + 1], child_x[c], child_y[c], quarter, depth + 1);
+
+			auto const& child = nodes[first_child + c];
+			mass += child.mass;
+			mass_x += child.mass * child.mass_x;
+			mass_y += child.mass * child.mass_y;
+
+			charge += child.charge;
+			abs_charge += child.abs_charge;
+			charge_x += child.abs_charge * child.charge_x;
+			charge_y += child.abs_charge * child.charge_y;
+		}
+	}
+
+	auto& nd = nodes[index];
+	nd.mass = mass;
+	nd.charge = charge;
+	nd.abs_charge = abs_charge;
+	if (mass > 0.f) {
+		nd.mass_x = mass_x / mass;
+		nd.mass_y = mass_y / mass;
+	}
+	if (abs_charge > 0.f) {
+		nd.charge_x = charge_x / abs_charge;
+		nd.charge_y = charge_y / abs_charge;
+	}
+}
+
+mathematics::vector<float, 2> barnes_hut_tree::force_on(size_t i, size_t* interactions) const noexcept {
+	mathematics::vector<float, 2> force;
+
+	if (nodes.empty())
+		return force;
+
+	auto const x = xs[i];
+	auto const y = ys[i];
+	auto const m = masses[i];
+	auto const q = charges[i];
+	auto const theta_squared = opening_angle * opening_angle;
+
+	float fx = 0.f;
+	float fy = 0.f;
+	size_t terms = 0;
+
+	auto const add = [&](float coupling, float sx, float sy) {
+		++terms;
+		auto const dx = sx - x;
+		auto const dy = sy - y;
+		auto const dist_squared = dx * dx + dy * dy;
+		auto const dist = std::sqrt(dist_squared);
+		auto const scale = coupling / (dist_squared * dist);
+		fx += scale * dx;
+		fy += scale * dy;
+	};
+
+	size_t stack[4 * max_depth + 4];
+	size_t top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		auto const& nd = nodes[stack[--top]];
+
+		if (nd.begin == nd.end)
+			continue;
+
+		if (nd.first_child == no_children) {
+			for (auto o = nd.begin; o < nd.end; ++o) {
+				auto const j = order[o];
+				if (j == i)
+					continue;
+				add(g * m * masses[j], xs[j], ys[j]);
+				if (q != 0.f and charges[j] != 0.f)
+					add(k * q * charges[j], xs[j], ys[j]);
+			}
+			continue;
+		}
+
+		// A node containing the particle itself always has to be opened,
+		// otherwise large opening angles let it attract itself.
+		auto const contains_particle = std::abs(x - nd.center_x) <= nd.half_width and std::abs(y - nd.center_y) <= nd.half_width;
+		auto const size_squared = 4.f * nd.half_width * nd.half_width;
+
+		auto const mdx = nd.mass_x - x;
+		auto const mdy = nd.mass_y - y;
+		auto const cdx = nd.charge_x - x;
+		auto const cdy = nd.charge_y - y;
+
+		auto const far_enough = [&](float dx, float dy) {
+			return size_squared < theta_squared * (dx * dx + dy * dy);
+		};
+
+		if (!contains_particle and far_enough(mdx, mdy) and far_enough(cdx, cdy)) {
+			add(g * m * nd.mass, nd.mass_x, nd.mass_y);
+			if (q != 0.f and nd.charge != 0.f)
+				add(k * q * nd.charge, nd.charge_x, nd.charge_y);
+			continue;
+		}
+
+		for (auto c = 0; c < 4; ++c)
+			stack[top++] = nd.first_child + c;
+	}
+
+	if (interactions)
+		*interactions += terms;
+
+	force[0] = fx;
+	force[1] = fy;
+	return force;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include "point_particle.hpp"
+
+// Quadtree over particle positions with mass and charge monopoles stored
+// in every node. Rebuilt from scratch each step, then queried once per
+// particle, so the force pass is O(N log N) instead of O(N^2).
+class barnes_hut_tree {
+public:
+	explicit barnes_hut_tree(float opening_angle = 0.5f) noexcept;
+
+	// Theta in the usual node_size / distance < theta acceptance test.
+	// 0 degenerates to the direct sum, larger is faster and less accurate.
+	void set_opening_angle(float theta) noexcept;
+	float get_opening_angle() const noexcept;
+
+	void build(particle_arrays const& particles);
+
+	// Gravity plus Coulomb force on the particle with dense index i at the
+	// time of build(). If interactions is given, the number of particle and
+	// node terms summed is added to it.
+	mathematics::vector<float, 2> force_on(size_t i, size_t* interactions = nullptr) const noexcept;
+
+	size_t size() const noexcept {
+		return xs.size();
+	}
+
+private:
+	struct node {
+		float center_x;
+		float center_y;
+		float half_width;
+
+		float mass;
+		float mass_x;
+		float mass_y;
+
+		// Charges of both signs live in the same node, so the position
+		// used for the net charge is weighted by |q|.
+		float charge;
+		float abs_charge;
+		float charge_x;
+		float charge_y;
+
+		size_t begin;
+		size_t end;
+		size_t first_child;
+	};
+
+	static constexpr size_t no_children = static_cast<size_t>(-1);
+	static constexpr size_t leaf_capacity = 8;
+	static constexpr size_t max_depth = 24;
+
+	void build_node(size_t index, size_t begin, size_t end, float center_x, float center_y, float half_width, size_t depth);
+
+	float opening_angle;
+
+	std::vector<node> nodes;
+	std::vector<size_t> order;
+
+	std::vector<float> xs;
+	std::vector<float> ys;
+	std::vector<float> masses;
+	std::vector<float> charges;
+};
@@ -0,0 +1,710 @@
+// benchmarks.cpp : Microbenchmarks for the simulation hot paths.
+//
+// usage: 2d_physics_bench [--particles 500,2000,8000] [--threads 1,2,4]
+//                         [--min-time 0.25] [--filter name] [--json]
+//
+// Prints one CSV row (or one JSON object per line with --json) per
+// benchmark, particle count and thread count, so runs can be diffed.
+// ns_per_pair divides by the N(N-1)/2 pairs a direct sum evaluates and is 0
+// where that means nothing; items_per_s counts particles (or pairs, for the
+// sort).
+
+#include "barnes_hut.hpp"
+#include "direct_sum_kernels.hpp"
+#include "fast_multipole.hpp"
+#include "force_accumulator.hpp"
+#include "force_laws.hpp"
+#include "index_range.hpp"
+#include "mathematics.hpp"
+#include "neighbour_list.hpp"
+#include "pair_tiles.hpp"
+#include "particle_mesh.hpp"
+#include "simulation.hpp"
+#include "spatial_grid.hpp"
+#include "system_scheduler.hpp"
+#include "thread_pool.hpp"
+#include "trajectory.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+
+	struct options {
+		std::vector<size_t> particle_counts{ 500, 2000, 8000 };
+		std::vector<size_t> thread_counts;
+		double min_time = 0.25;
+		std::string filter;
+		bool json = false;
+	};
+
+	struct result {
+		std::string_view name;
+		size_t particles;
+		size_t threads;
+		size_t iterations;
+		double ns_per_iteration;
+		// Work done by one iteration, for the normalized columns. 0 if the
+		// benchmark has no meaningful pair count.
+		size_t pairs;
+		size_t items;
+	};
+
+	// Runs f until min_time has passed, at least three times, and returns
+	// the mean time per call.
+	template<typename Function>
+	std::pair<size_t, double> time_it(Function&& f, double min_time) {
+		using clock = std::chrono::steady_clock;
+		using nanoseconds = std::chrono::duration<double, std::nano>;
+
+		f();
+
+		size_t iterations = 0;
+		auto const start = clock::now();
+		auto elapsed = nanoseconds(0);
+		while (iterations < 3 or elapsed.count() < min_time * 1e9) {
+			f();
+			++iterations;
+			elapsed = clock::now() - start;
+		}
+
+		return { iterations, elapsed.count() / iterations };
+	}
+
+	void print_header(options const& opts) {
+		if (!opts.json)
+			fmt::print("benchmark,particles,threads,iterations,ns_per_iteration,ns_per_pair,items_per_s\n");
+	}
+
+	void print_result(options const& opts, result const& r) {
+		auto const ns_per_pair = r.pairs == 0 ? 0.0 : r.ns_per_iteration / r.pairs;
+		auto const items_per_s = r.items * 1e9 / r.ns_per_iteration;
+
+		if (opts.json) {
+			fmt::print("{{\"benchmark\":\"{}\",\"particles\":{},\"threads\":{},\"iterations\":{},\"ns_per_iteration\":{:.1f},\"ns_per_pair\":{:.4f},\"items_per_s\":{:.6g}}}\n",
+				r.name, r.particles, r.threads, r.iterations, r.ns_per_iteration, ns_per_pair, items_per_s);
+		}
+		else {
+			fmt::print("{},{},{},{},{:.1f},{:.4f},{:.6g}\n",
+				r.name, r.particles, r.threads, r.iterations, r.ns_per_iteration, ns_per_pair, items_per_s);
+		}
+		std::fflush(stdout);
+	}
+
+	// Threads the simulations made by make_simulation step on.
+	unsigned pool_threads = 0;
+
+	// Sets the threads of every pool made meanwhile to n while alive.
+	class thread_limit {
+	public:
+		explicit thread_limit(size_t n)
+			: previous(std::exchange(pool_threads, static_cast<unsigned>(n))) {
+		}
+
+		~thread_limit() {
+			pool_threads = previous;
+		}
+
+	private:
+		unsigned previous;
+	};
+
+	size_t pair_count(size_t n) {
+		return n < 2 ? 0 : n * (n - 1) / 2;
+	}
+
+	// spawn_particles makes five particles per dot.
+	std::unique_ptr<simulation> make_simulation(size_t particles) {
+		auto sim = std::make_unique<simulation>();
+		sim->set_threads({ pool_threads });
+		sim->spawn_particles(std::max<size_t>(1, particles / 5));
+		return sim;
+	}
+
+	struct benchmark {
+		std::string_view name;
+		// Serial benchmarks only run once, with threads reported as 1.
+		bool parallel;
+		std::function<result(size_t particles, double min_time)> run;
+	};
+
+	template<force_solver Solver, bool Deterministic = false, unsigned Levels = 0, unsigned Inner = 1, integrator Integration = integrator::leapfrog>
+	result bench_step(std::string_view name, size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		sim->set_force_solver(Solver);
+		sim->set_deterministic(Deterministic);
+		sim->set_timestep_levels(Levels);
+		sim->set_inner_steps(Inner);
+		sim->set_integrator(Integration);
+
+		auto const evaluations = integrators::dispatch(Integration, []<typename I>() { return I::force_evaluations; });
+		auto const [iterations, ns] = time_it([&] { sim->step(); }, min_time);
+		return { name, sim->size(), 0, iterations, ns, Solver == force_solver::barnes_hut or Solver == force_solver::particle_mesh or Solver == force_solver::fast_multipole or Solver == force_solver::short_range ? 0 : evaluations * pair_count(sim->size()), sim->size() };
+	}
+
+	// The pair phase of physical_interaction on its own, as the direct sum
+	// runs it: a task graph on the stepping pool with a pass per tile into
+	// per-thread force buffers, and each block of particles taking its sums
+	// once the tiles in its row and column are done. Interaction is
+	// pair_force, or species_pair_force as the step uses.
+	template<typename Interaction>
+	result bench_tile_pass(std::string_view name, size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const p = get_particle_arrays(sim->manager, sim->species_registry);
+
+		pair_tiles const tiles(p.size);
+		thread_pool pool({ pool_threads });
+		force_accumulator forces(pool.size());
+		forces.resize(p.size);
+		task_graph graph;
+
+		auto const tile_size = tiles.get_tile_size();
+		auto const tile_rows = (p.size + tile_size - 1) / tile_size;
+		std::vector<task_graph::node> finish(tile_rows);
+
+		auto const pass = [&] {
+			graph.clear();
+			for (size_t b = 0; b < tile_rows; ++b) {
+				auto const first = b * tile_size;
+				auto const count = std::min(p.size, first + tile_size) - first;
+				finish[b] = graph.add(count, [&forces, p, first](size_t k) {
+					auto const f = forces.take(first + k);
+					p.fx[first + k] = f[0];
+					p.fy[first + k] = f[1];
+				}, 64);
+			}
+
+			for (size_t t = 0; t < tiles.size(); ++t) {
+				auto const tile = tiles[t];
+				auto const tile_pass = graph.add(1, [&forces, p, tile](size_t) {
+					auto slot = forces.acquire();
+					tile.for_each_pair([&p, &slot](size_t i, size_t j) {
+						auto const force = Interaction::force(p, i, j);
+						slot[i] += force;
+						slot[j] -= force;
+					});
+				});
+				graph.precede(tile_pass, finish[tile.row_begin / tile_size]);
+				if (!tile.on_diagonal())
+					graph.precede(tile_pass, finish[tile.column_begin / tile_size]);
+			}
+
+			pool.run(graph);
+			forces.end_pass();
+		};
+
+		auto const [iterations, ns] = time_it(pass, min_time);
+		return { name, p.size, 0, iterations, ns, pair_count(p.size), p.size };
+	}
+
+	result bench_vector_kernel(size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const p = get_particle_arrays(sim->manager);
+		auto const kernel = get_direct_sum_kernel(best_simd_level());
+
+		constexpr size_t block_size = 64;
+		index_range const blocks((p.size + block_size - 1) / block_size);
+		thread_pool pool({ pool_threads });
+
+		auto const pass = [&] {
+			pool.for_each(blocks, [kernel, p](size_t b) {
+				kernel(p, b * block_size, std::min(p.size, (b + 1) * block_size));
+			});
+		};
+
+		auto const [iterations, ns] = time_it(pass, min_time);
+		return { "direct_sum_kernel", p.size, 0, iterations, ns, pair_count(p.size), p.size };
+	}
+
+	result bench_tree_build(size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const p = get_particle_arrays(sim->manager);
+		barnes_hut_tree tree;
+
+		auto const [iterations, ns] = time_it([&] { tree.build(p); }, min_time);
+		return { "barnes_hut_build", p.size, 0, iterations, ns, 0, p.size };
+	}
+
+	result bench_tree_forces(size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const p = get_particle_arrays(sim->manager);
+		barnes_hut_tree tree;
+		tree.build(p);
+		thread_pool pool({ pool_threads });
+
+		auto const pass = [&] {
+			pool.for_each(index_range(p.size), [&tree, p](size_t i) {
+				auto const f = tree.force_on(i);
+				p.fx[i] = f[0];
+				p.fy[i] = f[1];
+			});
+		};
+
+		auto const [iterations, ns] = time_it(pass, min_time);
+		return { "barnes_hut_forces", p.size, 0, iterations, ns, 0, p.size };
+	}
+
+	// Depositing, the transforms and sorting into chains, with the kernels
+	// already prepared by a first build.
+	result bench_mesh_build(size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const p = get_particle_arrays(sim->manager);
+		thread_pool pool({ pool_threads });
+		particle_mesh mesh;
+		mesh.build(pool, p, {});
+
+		auto const [iterations, ns] = time_it([&] { mesh.build(pool, p, {}); }, min_time);
+		return { "mesh_build", p.size, 0, iterations, ns, 0, p.size };
+	}
+
+	result bench_mesh_forces(size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const p = get_particle_arrays(sim->manager);
+		thread_pool pool({ pool_threads });
+		particle_mesh mesh;
+		mesh.build(pool, p, {});
+
+		auto const pass = [&] {
+			pool.for_each(index_range(p.size), [&mesh, p](size_t i) {
+				auto const f = mesh.force_on(i);
+				p.fx[i] = f[0];
+				p.fy[i] = f[1];
+			});
+		};
+
+		auto const [iterations, ns] = time_it(pass, min_time);
+		return { "mesh_forces", p.size, 0, iterations, ns, 0, p.size };
+	}
+
+	// Tree, both passes and the interaction lists.
+	result bench_multipole_build(size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const p = get_particle_arrays(sim->manager);
+		thread_pool pool({ pool_threads });
+		fast_multipole multipole;
+
+		auto const [iterations, ns] = time_it([&] { multipole.build(pool, p, {}); }, min_time);
+		return { "multipole_build", p.size, 0, iterations, ns, 0, p.size };
+	}
+
+	result bench_multipole_forces(size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const p = get_particle_arrays(sim->manager);
+		thread_pool pool({ pool_threads });
+		fast_multipole multipole;
+		multipole.build(pool, p, {});
+
+		auto const pass = [&] {
+			pool.for_each(index_range(p.size), [&multipole, p](size_t i) {
+				auto const f = multipole.force_on(i);
+				p.fx[i] = f[0];
+				p.fy[i] = f[1];
+			});
+		};
+
+		auto const [iterations, ns] = time_it(pass, min_time);
+		return { "multipole_forces", p.size, 0, iterations, ns, 0, p.size };
+	}
+
+	// What generate_pairs used to produce: every pair, here in tile order.
+	result bench_tile_walk(size_t particles, double min_time) {
+		pair_tiles const tiles(particles);
+		size_t volatile sink = 0;
+
+		auto const walk = [&] {
+			size_t checksum = 0;
+			for (auto t : tiles)
+				t.for_each_pair([&checksum](size_t i, size_t j) { checksum += i ^ j; });
+			sink = checksum;
+		};
+
+		auto const [iterations, ns] = time_it(walk, min_time);
+		return { "pair_walk", particles, 1, iterations, ns, tiles.pair_count(), particles };
+	}
+
+	// One light pass over every particle on the stepping pool, so mostly
+	// the cost of splitting, stealing and joining.
+	result bench_pool_pass(size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const p = get_particle_arrays(sim->manager);
+		thread_pool pool({ pool_threads });
+		index_range const everyone(p.size);
+
+		auto const pass = [&] {
+			pool.for_each(everyone, [p](size_t i) {
+				p.x[i] += 1e-6f * p.vx[i];
+				p.y[i] += 1e-6f * p.vy[i];
+			});
+		};
+
+		auto const [iterations, ns] = time_it(pass, min_time);
+		return { "pool_pass", p.size, 0, iterations, ns, 0, p.size };
+	}
+
+	// The short-range laws over the neighbours, with the particles nudged a
+	// little between passes as by a short inner step: binned every pass, or
+	// with Verlet lists that outlast the nudges.
+	template<bool Verlet>
+	result bench_neighbours(std::string_view name, size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const p = get_particle_arrays(sim->manager);
+		thread_pool pool({ pool_threads });
+		index_range const everyone(p.size);
+		neighbour_list neighbours;
+		neighbour_list::settings const settings{ short_range_pair_force::cutoff(), Verlet ? 8.f : 0.f };
+		size_t pairs = 0;
+		float nudge = 0.01f;
+
+		auto const pass = [&] {
+			nudge = -nudge;
+			pool.for_each(everyone, [p, nudge](size_t i) {
+				p.x[i] += nudge;
+			});
+
+			neighbours.update(pool, p, settings);
+			std::atomic<size_t> found = 0;
+			pool.for_each(everyone, [&neighbours, &found, p](size_t i) {
+				mathematics::vector<float, 2> total;
+				size_t count = 0;
+				neighbours.for_each_neighbour(i, [&](size_t j) {
+					total += short_range_pair_force::force(p, i, j);
+					++count;
+				});
+				p.fx[i] = total[0];
+				p.fy[i] = total[1];
+				found.fetch_add(count, std::memory_order_relaxed);
+			});
+			pairs = found.load();
+		};
+
+		auto const [iterations, ns] = time_it(pass, min_time);
+		return { name, p.size, 0, iterations, ns, pairs, p.size };
+	}
+
+	// A kick, a drift and clearing the forces, each its own sweep over the
+	// particles or fused into one by the system scheduler.
+	template<bool Fused>
+	result bench_sweeps(std::string_view name, size_t particles, double min_time) {
+		using particle_systems = system_scheduler<point_particle_components>;
+
+		auto sim = make_simulation(particles);
+		auto const p = get_particle_arrays(sim->manager);
+		thread_pool pool({ pool_threads });
+		particle_systems scheduler;
+
+		auto const kick = particle_systems::each_entity(reads<AccelerationX, AccelerationY>{}, writes<VelocityX, VelocityY>{}, [p](size_t i) {
+			p.vx[i] += 1e-6f * p.ax[i];
+			p.vy[i] += 1e-6f * p.ay[i];
+		});
+		auto const drift = particle_systems::each_entity(reads<VelocityX, VelocityY>{}, writes<PositionX, PositionY>{}, [p](size_t i) {
+			p.x[i] += 1e-6f * p.vx[i];
+			p.y[i] += 1e-6f * p.vy[i];
+		});
+		auto const clear = particle_systems::each_entity(reads<>{}, writes<ForceX, ForceY>{}, [p](size_t i) {
+			p.fx[i] = 0.f;
+			p.fy[i] = 0.f;
+		});
+
+		auto const sweeps = [&] {
+			if constexpr (Fused) {
+				scheduler.run(pool, p.size, kick, drift, clear);
+			}
+			else {
+				scheduler.run(pool, p.size, kick);
+				scheduler.run(pool, p.size, drift);
+				scheduler.run(pool, p.size, clear);
+			}
+		};
+
+		auto const [iterations, ns] = time_it(sweeps, min_time);
+		return { name, p.size, 0, iterations, ns, 0, p.size };
+	}
+
+	// What sort_pairs used to do, capped so the pair list stays small.
+	result bench_sort_by_distance(size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const p = get_particle_arrays(sim->manager);
+
+		constexpr size_t max_pairs = size_t(1) << 20;
+		std::vector<std::pair<size_t, size_t>> unsorted;
+		for (auto t : pair_tiles(p.size)) {
+			t.for_each_pair([&unsorted](size_t i, size_t j) {
+				if (unsorted.size() < max_pairs)
+					unsorted.emplace_back(i, j);
+			});
+			if (unsorted.size() >= max_pairs)
+				break;
+		}
+
+		auto pairs = unsorted;
+		auto const sort = [&] {
+			pairs = unsorted;
+			std::sort(pairs.begin(), pairs.end(), [p](auto const& a, auto const& b) { return compare_by_distance(p, a, b); });
+		};
+
+		auto const [iterations, ns] = time_it(sort, min_time);
+		return { "sort_by_distance", p.size, 1, iterations, ns, pairs.size(), pairs.size() };
+	}
+
+	result bench_select(size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		size_t volatile sink = 0;
+
+		// The middle quarter of the spawn region.
+		float const x0 = simulation::width / 4.f;
+		float const y0 = simulation::height / 4.f;
+		auto const query = [&] {
+			sink = sim->particles_in_box(x0, y0, 3 * x0, 3 * y0).size();
+		};
+
+		auto const [iterations, ns] = time_it(query, min_time);
+		return { "select", sim->size(), 1, iterations, ns, 0, sim->size() };
+	}
+
+	result bench_grid_build(size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const& m = sim->manager;
+		spatial_grid grid;
+
+		auto const build = [&] {
+			grid.build(m.get_storage_for_component<PositionX>(), m.get_storage_for_component<PositionY>(),
+				m.get_storage_for_component<Mass>(), m.get_storage_for_component<Charge>(),
+				m.get_storage_for_component<VelocityX>(), m.get_storage_for_component<VelocityY>());
+		};
+
+		auto const [iterations, ns] = time_it(build, min_time);
+		return { "grid_build", sim->size(), 1, iterations, ns, 0, sim->size() };
+	}
+
+	// The same box as select, answered from the grid: hits plus totals.
+	result bench_grid_select(size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const& m = sim->manager;
+		spatial_grid grid;
+		grid.build(m.get_storage_for_component<PositionX>(), m.get_storage_for_component<PositionY>(),
+			m.get_storage_for_component<Mass>(), m.get_storage_for_component<Charge>(),
+			m.get_storage_for_component<VelocityX>(), m.get_storage_for_component<VelocityY>());
+		size_t volatile sink = 0;
+
+		float const x0 = simulation::width / 4.f;
+		float const y0 = simulation::height / 4.f;
+		auto const query = [&] {
+			sink = grid.query_box(x0, y0, 3 * x0, 3 * y0).size() + grid.summarize_box(x0, y0, 3 * x0, 3 * y0).count;
+		};
+
+		auto const [iterations, ns] = time_it(query, min_time);
+		return { "grid_select", sim->size(), 1, iterations, ns, 0, sim->size() };
+	}
+
+	// Recording every step, so once the writer thread's queue is full this
+	// is the sustained rate of quantizing, compressing and writing frames.
+	result bench_trajectory_record(size_t particles, double min_time) {
+		auto sim = make_simulation(particles);
+		auto const path = (std::filesystem::temp_directory_path() / "2d_physics_bench.traj").string();
+
+		trajectory_writer writer;
+		trajectory_writer::options opts;
+		opts.every = 1;
+		if (!writer.open(path, opts))
+			return { "trajectory_record", sim->size(), 1, 0, 0.0, 0, sim->size() };
+
+		auto const record = [&] {
+			writer.record(*sim);
+		};
+
+		auto const [iterations, ns] = time_it(record, min_time);
+		writer.close();
+		std::filesystem::remove(path);
+		return { "trajectory_record", sim->size(), 1, iterations, ns, 0, sim->size() };
+	}
+
+	result bench_columnar_push_back(size_t particles, double min_time) {
+		auto const fill = [particles] {
+			EntityManagerType manager;
+			species_table species;
+			for (size_t i = 0; i < particles; ++i)
+				add_particle(manager, species, float(i), float(i), 1.f, 0.f);
+		};
+
+		auto const [iterations, ns] = time_it(fill, min_time);
+		return { "columnar_push_back", particles, 1, iterations, ns, 0, particles };
+	}
+
+	struct LegacyBody { float x, y, vx, vy, mass; };
+	struct LegacyCharge { float charge; };
+	using legacy_entity = Entity<ListsViaTypes::TypeList<LegacyBody, LegacyCharge>>;
+
+	// The pointer-per-component EntityManager; make_entity goes through
+	// register_entity.
+	result bench_register_entity(size_t particles, double min_time) {
+		auto const fill = [particles] {
+			EntityManager<legacy_entity, std::vector> manager;
+			for (size_t i = 0; i < particles; ++i)
+				manager.make_entity(LegacyBody{ float(i), float(i), 0.f, 0.f, 1.f }, LegacyCharge{ 0.f });
+		};
+
+		auto const [iterations, ns] = time_it(fill, min_time);
+		return { "register_entity", particles, 1, iterations, ns, 0, particles };
+	}
+
+	result bench_vector_ops(size_t particles, double min_time) {
+		using mathematics::vector;
+		std::vector<vector<float, 2>> a(particles, vector<float, 2>{ 1.f, 2.f });
+		std::vector<vector<float, 2>> b(particles, vector<float, 2>{ 0.5f, -1.f });
+
+		auto const axpy = [&] {
+			for (size_t i = 0; i < particles; ++i)
+				a[i] += 0.5f * (b[i] - a[i]);
+		};
+
+		auto const [iterations, ns] = time_it(axpy, min_time);
+		return { "vector_ops", particles, 1, iterations, ns, 0, particles };
+	}
+
+	template<size_t N>
+	result bench_matrix_multiply(std::string_view name, size_t particles, double min_time) {
+		using mathematics::matrix;
+		std::vector<matrix<float, N, N>> ms(particles);
+		for (auto& m : ms)
+			for (size_t i = 0; i < N; ++i)
+				m(i, i) = 1.f;
+		matrix<float, N, N> rotation;
+		rotation(0, 1) = 1.f;
+		rotation(1, 0) = -1.f;
+
+		auto const multiply = [&] {
+			for (auto& m : ms)
+				m = m * rotation;
+		};
+
+		auto const [iterations, ns] = time_it(multiply, min_time);
+		return { name, particles, 1, iterations, ns, 0, particles };
+	}
+
+	std::vector<size_t> parse_list(char const* text) {
+		std::vector<size_t> values;
+		std::string_view rest(text);
+		while (!rest.empty()) {
+			auto const comma = rest.find(',');
+			auto const value = std::strtoull(std::string(rest.substr(0, comma)).c_str(), nullptr, 10);
+			if (value > 0)
+				values.push_back(value);
+			rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+		}
+		return values;
+	}
+
+	std::vector<size_t> default_thread_counts() {
+		std::vector<size_t> counts;
+		auto const hw = std::max<size_t>(1, std::thread::hardware_concurrency());
+		for (size_t t = 1; t < hw; t *= 2)
+			counts.push_back(t);
+		counts.push_back(hw);
+		return counts;
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	options opts;
+
+	for (int a = 1; a < argc; ++a) {
+		std::string_view const arg(argv[a]);
+		auto const has_value = a + 1 < argc;
+
+		if (arg == "--particles" and has_value)
+			opts.particle_counts = parse_list(argv[++a]);
+		else if (arg == "--threads" and has_value)
+			opts.thread_counts = parse_list(argv[++a]);
+		else if (arg == "--min-time" and has_value)
+			opts.min_time = std::strtod(argv[++a], nullptr);
+		else if (arg == "--filter" and has_value)
+			opts.filter = argv[++a];
+		else if (arg == "--json")
+			opts.json = true;
+		else {
+			fmt::print(stderr, "usage: {} [--particles 500,2000] [--threads 1,2,4] [--min-time seconds] [--filter name] [--json]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (opts.thread_counts.empty())
+		opts.thread_counts = default_thread_counts();
+
+	std::vector<benchmark> const benchmarks{
+		{ "step_direct_sum", true, [](size_t n, double t) { return bench_step<force_solver::direct_sum>("step_direct_sum", n, t); } },
+		{ "step_direct_sum_deterministic", true, [](size_t n, double t) { return bench_step<force_solver::direct_sum, true>("step_direct_sum_deterministic", n, t); } },
+		{ "step_block_timesteps", true, [](size_t n, double t) { return bench_step<force_solver::direct_sum, false, 3>("step_block_timesteps", n, t); } },
+		{ "step_respa", true, [](size_t n, double t) { return bench_step<force_solver::direct_sum, false, 0, 4>("step_respa", n, t); } },
+		{ "step_velocity_verlet", true, [](size_t n, double t) { return bench_step<force_solver::direct_sum, false, 0, 1, integrator::velocity_verlet>("step_velocity_verlet", n, t); } },
+		{ "step_forest_ruth", true, [](size_t n, double t) { return bench_step<force_solver::direct_sum, false, 0, 1, integrator::forest_ruth>("step_forest_ruth", n, t); } },
+		{ "step_vectorized", true, [](size_t n, double t) { return bench_step<force_solver::vectorized_direct_sum>("step_vectorized", n, t); } },
+		{ "step_barnes_hut", true, [](size_t n, double t) { return bench_step<force_solver::barnes_hut>("step_barnes_hut", n, t); } },
+		{ "step_particle_mesh", true, [](size_t n, double t) { return bench_step<force_solver::particle_mesh>("step_particle_mesh", n, t); } },
+		{ "step_fast_multipole", true, [](size_t n, double t) { return bench_step<force_solver::fast_multipole>("step_fast_multipole", n, t); } },
+		{ "step_short_range", true, [](size_t n, double t) { return bench_step<force_solver::short_range>("step_short_range", n, t); } },
+		{ "pair_tiles", true, [](size_t n, double t) { return bench_tile_pass<pair_force>("pair_tiles", n, t); } },
+		{ "pair_tiles_species", true, [](size_t n, double t) { return bench_tile_pass<species_pair_force>("pair_tiles_species", n, t); } },
+		{ "direct_sum_kernel", true, bench_vector_kernel },
+		{ "barnes_hut_build", false, bench_tree_build },
+		{ "barnes_hut_forces", true, bench_tree_forces },
+		{ "mesh_build", true, bench_mesh_build },
+		{ "mesh_forces", true, bench_mesh_forces },
+		{ "multipole_build", true, bench_multipole_build },
+		{ "multipole_forces", true, bench_multipole_forces },
+		{ "pair_walk", false, bench_tile_walk },
+		{ "pool_pass", true, bench_pool_pass },
+		{ "neighbours_cells", true, [](size_t n, double t) { return bench_neighbours<false>("neighbours_cells", n, t); } },
+		{ "neighbours_verlet", true, [](size_t n, double t) { return bench_neighbours<true>("neighbours_verlet", n, t); } },
+		{ "sweeps_separate", true, [](size_t n, double t) { return bench_sweeps<false>("sweeps_separate", n, t); } },
+		{ "sweeps_fused", true, [](size_t n, double t) { return bench_sweeps<true>("sweeps_fused", n, t); } },
+		{ "sort_by_distance", false, bench_sort_by_distance },
+		{ "select", false, bench_select },
+		{ "grid_build", false, bench_grid_build },
+		{ "grid_select", false, bench_grid_select },
+		{ "trajectory_record", false, bench_trajectory_record },
+		{ "columnar_push_back", false, bench_columnar_push_back },
+		{ "register_entity", false, bench_register_entity },
+		{ "vector_ops", false, bench_vector_ops },
+		{ "matrix2_multiply", false, [](size_t n, double t) { return bench_matrix_multiply<2>("matrix2_multiply", n, t); } },
+		{ "matrix3_multiply", false, [](size_t n, double t) { return bench_matrix_multiply<3>("matrix3_multiply", n, t); } },
+	};
+
+	print_header(opts);
+
+	for (auto const& b : benchmarks) {
+		if (!opts.filter.empty() and b.name.find(opts.filter) == std::string_view::npos)
+			continue;
+
+		for (auto const n : opts.particle_counts) {
+			if (!b.parallel) {
+				auto r = b.run(n, opts.min_time);
+				r.threads = 1;
+				print_result(opts, r);
+				continue;
+			}
+
+			for (auto const threads : opts.thread_counts) {
+				thread_limit const limit(threads);
+				auto r = b.run(n, opts.min_time);
+				r.threads = threads;
+				print_result(opts, r);
+			}
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#include "block_timesteps.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "index_range.hpp"
+
+unsigned block_timesteps::level_for(float ax, float ay) const noexcept {
+	auto const a = std::hypot(ax, ay);
+	if (!(a > 0.f))
+		return 0;
+
+	auto const wanted = config.accuracy * std::sqrt(config.length / a);
+	if (!(wanted < config.step))
+		return 0;
+
+	// The smallest l with step / 2^l <= wanted.
+	auto const level = std::ceil(std::log2(config.step / wanted));
+	return level >= config.max_level ? config.max_level : static_cast<unsigned>(level);
+}
+
+void block_timesteps::begin(thread_pool& pool, particle_arrays const& p, settings const& new_settings) {
+	config = new_settings;
+	config.max_level = std::min(config.max_level, max_supported_level);
+
+	levels.resize(p.size);
+	step_end.resize(p.size);
+
+	index_range const everyone(p.size);
+	pool.for_each(everyone, [this, &p](size_t i) {
+		auto const level = level_for(p.ax[i], p.ay[i]);
+		levels[i] = static_cast<uint8_t>(level);
+		step_end[i] = uint32_t(1) << (config.max_level - level);
+	});
+
+	std::fill(level_population.begin(), level_population.end(), 0);
+	for (auto const level : levels)
+		++level_population[level];
+}
+
+uint32_t block_timesteps::next_event() const noexcept {
+	// The finest occupied level decides, but levels only get finer inside
+	// a step, so scanning is simpler than keeping per-level lists in sync.
+	auto next = std::numeric_limits<uint32_t>::max();
+	for (auto const end : step_end)
+		next = std::min(next, end);
+	return next;
+}
+
+std::span<uint32_t const> block_timesteps::collect_active(uint32_t now) {
+	active.clear();
+	for (size_t i = 0; i < step_end.size(); ++i) {
+		if (step_end[i] == now)
+			active.push_back(static_cast<uint32_t>(i));
+	}
+	return active;
+}
+
+void block_timesteps::reschedule(size_t i, uint32_t now, float ax, float ay) noexcept {
+	auto const level = std::max<unsigned>(levels[i], level_for(ax, ay));
+	levels[i] = static_cast<uint8_t>(level);
+	step_end[i] = now + (uint32_t(1) << (config.max_level - level));
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "particle_arrays.hpp"
+#include "thread_pool.hpp"
+
+// Bookkeeping for hierarchical power-of-two block timesteps. A particle on
+// level l steps by dt / 2^l, where dt is the full step, so one full step is
+// 2^max_level ticks of the finest level and a level l step lasts
+// 2^(max_level - l) ticks. Every step size divides the ones above it, so
+// particles that end a step on the same tick always do so together and all
+// of them line up again at the end of dt.
+//
+// Levels are picked from the acceleration, h = accuracy * sqrt(length / |a|),
+// rounded down to the next power-of-two fraction of dt. Inside a step a
+// particle may only move to finer levels, which keeps it aligned; it can
+// coarsen again at the start of the next step.
+class block_timesteps {
+public:
+	static constexpr unsigned max_supported_level = 16;
+
+	struct settings {
+		unsigned max_level = 4;
+		float accuracy = 0.2f;
+		float length = 1.f;
+		float step = dt;
+	};
+
+	size_t size() const noexcept {
+		return levels.size();
+	}
+
+	// Assigns every particle a level from p.ax and p.ay and schedules its
+	// first step end.
+	void begin(thread_pool& pool, particle_arrays const& p, settings const& new_settings);
+
+	uint32_t ticks_per_step() const noexcept {
+		return uint32_t(1) << config.max_level;
+	}
+
+	float tick() const noexcept {
+		return config.step / static_cast<float>(ticks_per_step());
+	}
+
+	// Length of particle i's current step.
+	float step_of(size_t i) const noexcept {
+		return config.step / static_cast<float>(uint32_t(1) << levels[i]);
+	}
+
+	// Earliest tick at which some particle ends its step.
+	uint32_t next_event() const noexcept;
+
+	// Particles ending their step at tick now, in increasing index order.
+	std::span<uint32_t const> collect_active(uint32_t now);
+
+	// Starts particle i's next step at tick now, on its current level or a
+	// finer one if its new acceleration asks for that.
+	void reschedule(size_t i, uint32_t now, float ax, float ay) noexcept;
+
+	// Particles per level as of begin().
+	std::span<size_t const> population() const noexcept {
+		return { level_population.data(), config.max_level + 1 };
+	}
+
+private:
+	unsigned level_for(float ax, float ay) const noexcept;
+
+	settings config;
+	std::vector<uint8_t> levels;
+	std::vector<uint32_t> step_end;
+	std::vector<uint32_t> active;
+	std::vector<size_t> level_population = std::vector<size_t>(max_supported_level + 1);
+};
@@ -0,0 +1,389 @@
+#include "checkpoint.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <utility>
+
+#include <fmt/format.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	// Selectable is front end state and stays out of checkpoints. Species
+	// ids follow from the masses and charges, so they are assigned again on
+	// restore rather than stored.
+	using checkpointed_components = ListsViaTypes::TypeList<
+		PositionX, PositionY,
+		VelocityX, VelocityY,
+		AccelerationX, AccelerationY,
+		ForceX, ForceY,
+		Mass, Charge>;
+
+	template<typename List>
+	struct for_each_component;
+
+	template<typename ... Cs>
+	struct for_each_component<ListsViaTypes::TypeList<Cs...>> {
+		template<typename Function>
+		static void apply(Function&& f) {
+			(f.template operator()<Cs>(), ...);
+		}
+	};
+
+	constexpr uint64_t align_up(uint64_t offset) noexcept {
+		return (offset + checkpoint_format::alignment - 1) / checkpoint_format::alignment * checkpoint_format::alignment;
+	}
+
+	struct file_closer {
+		void operator()(std::FILE* f) const noexcept {
+			std::fclose(f);
+		}
+	};
+
+	// Waits for what was written to reach the disk, not just the OS.
+	bool sync_file(std::FILE* f) noexcept {
+#if defined(_WIN32)
+		return _commit(_fileno(f)) == 0;
+#else
+		return fsync(fileno(f)) == 0;
+#endif
+	}
+
+	// The same for the entries of a directory, so a rename into it is on
+	// disk too. Windows has no such call for directories.
+	bool sync_directory(std::filesystem::path const& directory) noexcept {
+#if defined(_WIN32)
+		(void)directory;
+		return true;
+#else
+		auto const fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+		if (fd < 0)
+			return false;
+		auto const ok = fsync(fd) == 0;
+		close(fd);
+		return ok;
+#endif
+	}
+
+}
+
+void capture_checkpoint(simulation const& sim, checkpoint_data& data) {
+	auto const& manager = sim.manager;
+
+	data.step = sim.get_step_count();
+	data.time = sim.get_elapsed_time();
+	data.particle_count = manager.size();
+	data.names.clear();
+
+	size_t c = 0;
+	for_each_component<checkpointed_components>::apply([&]<typename C>() {
+		auto const column = manager.get_storage_for_component<C>();
+		if (data.columns.size() <= c)
+			data.columns.emplace_back();
+		data.columns[c].assign(column.begin(), column.end());
+		data.names.push_back(C::name);
+		++c;
+	});
+	data.columns.resize(c);
+}
+
+bool write_checkpoint(std::string const& path, checkpoint_data const& data) {
+	using namespace checkpoint_format;
+
+	auto const column_count = data.columns.size();
+	auto const table_end = sizeof(header) + column_count * sizeof(column);
+
+	std::vector<column> table(column_count);
+	auto offset = align_up(table_end);
+	for (size_t c = 0; c < column_count; ++c) {
+		std::memset(&table[c], 0, sizeof(column));
+		std::strncpy(table[c].name, data.names[c], max_name_length - 1);
+		table[c].element_size = sizeof(float);
+		table[c].offset = offset;
+		table[c].byte_size = data.columns[c].size() * sizeof(float);
+		offset = align_up(offset + table[c].byte_size);
+	}
+
+	header h;
+	std::memset(&h, 0, sizeof(h));
+	std::memcpy(h.magic, magic, sizeof(magic));
+	h.version = version;
+	h.byte_order = byte_order_mark;
+	h.particle_count = data.particle_count;
+	h.step = data.step;
+	h.time = data.time;
+	h.column_count = static_cast<uint32_t>(column_count);
+	h.alignment = static_cast<uint32_t>(alignment);
+	h.file_size = offset;
+
+	auto const temporary = path + ".partial";
+	{
+		std::unique_ptr<std::FILE, file_closer> file(std::fopen(temporary.c_str(), "wb"));
+		if (!file) {
+			fmt::print(stderr, "Could not open {} for writing\n", temporary);
+			return false;
+		}
+
+		char const padding[alignment] = {};
+		uint64_t written = 0;
+		auto const write = [&](void const* bytes, size_t count) {
+			written += count;
+			return std::fwrite(bytes, 1, count, file.get()) == count;
+		};
+		auto const pad_to = [&](uint64_t target) {
+			return write(padding, static_cast<size_t>(target - written));
+		};
+
+		bool ok = write(&h, sizeof(h)) and write(table.data(), table.size() * sizeof(column));
+		for (size_t c = 0; ok and c < column_count; ++c)
+			ok = pad_to(table[c].offset) and write(data.columns[c].data(), table[c].byte_size);
+		ok = ok and pad_to(offset) and std::fflush(file.get()) == 0 and sync_file(file.get());
+
+		if (!ok) {
+			fmt::print(stderr, "Failed writing checkpoint {}\n", temporary);
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	if (error) {
+		fmt::print(stderr, "Could not move checkpoint into place at {}: {}\n", path, error.message());
+		return false;
+	}
+
+	if (!sync_directory(std::filesystem::path(path).parent_path())) {
+		fmt::print(stderr, "Could not sync the directory of {}\n", path);
+		return false;
+	}
+
+	return true;
+}
+
+checkpoint_writer::checkpoint_writer()
+	: writing(false),
+	worker([this](std::stop_token stop) { loop(stop); }) {
+}
+
+checkpoint_writer::~checkpoint_writer() {
+	wait();
+}
+
+void checkpoint_writer::save_async(simulation const& sim, std::string path) {
+	checkpoint_data data;
+	{
+		std::unique_lock l(lock);
+		data = std::move(spare);
+	}
+
+	capture_checkpoint(sim, data);
+
+	std::unique_lock l(lock);
+	if (pending) {
+		// The older request never started, so it is simply replaced.
+		std::swap(pending->second, data);
+		pending->first = std::move(path);
+		spare = std::move(data);
+	}
+	else {
+		pending.emplace(std::move(path), std::move(data));
+	}
+	work_changed.notify_all();
+}
+
+void checkpoint_writer::wait() {
+	std::unique_lock l(lock);
+	work_changed.wait(l, [this] { return !pending and !writing; });
+}
+
+void checkpoint_writer::loop(std::stop_token stop) {
+	std::unique_lock l(lock);
+
+	while (true) {
+		work_changed.wait(l, stop, [this] { return pending.has_value(); });
+		if (!pending)
+			return;
+
+		auto job = std::move(*pending);
+		pending.reset();
+		writing = true;
+
+		l.unlock();
+		if (write_checkpoint(job.first, job.second))
+			fmt::print("Saved step {} to {}\n", job.second.step, job.first);
+		l.lock();
+
+		if (spare.columns.empty())
+			spare = std::move(job.second);
+		writing = false;
+		work_changed.notify_all();
+	}
+}
+
+mapped_checkpoint::~mapped_checkpoint() {
+	close();
+}
+
+mapped_checkpoint::mapped_checkpoint(mapped_checkpoint&& other) noexcept
+	: data(std::exchange(other.data, nullptr)),
+	size(std::exchange(other.size, 0)),
+	last_error(std::move(other.last_error)) {
+}
+
+mapped_checkpoint& mapped_checkpoint::operator=(mapped_checkpoint&& other) noexcept {
+	if (this != &other) {
+		close();
+		data = std::exchange(other.data, nullptr);
+		size = std::exchange(other.size, 0);
+		last_error = std::move(other.last_error);
+	}
+	return *this;
+}
+
+bool mapped_checkpoint::fail(std::string message) {
+	close();
+	last_error = std::move(message);
+	return false;
+}
+
+bool mapped_checkpoint::open(std::string const& path) {
+	close();
+
+#if defined(_WIN32)
+	auto const file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return fail("could not open " + path);
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) or file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return fail("could not size " + path);
+	}
+
+	auto const mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping)
+		return fail("could not map " + path);
+
+	auto const view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!view)
+		return fail("could not map " + path);
+
+	data = static_cast<std::byte const*>(view);
+	size = static_cast<size_t>(file_size.QuadPart);
+#else
+	auto const fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return fail("could not open " + path);
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 or info.st_size == 0) {
+		::close(fd);
+		return fail("could not size " + path);
+	}
+
+	auto const view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED)
+		return fail("could not map " + path);
+
+	data = static_cast<std::byte const*>(view);
+	size = static_cast<size_t>(info.st_size);
+#endif
+
+	using namespace checkpoint_format;
+
+	if (size < sizeof(checkpoint_format::header))
+		return fail(path + " is too short to be a checkpoint");
+
+	auto const& h = header();
+	if (std::memcmp(h.magic, magic, sizeof(magic)) != 0)
+		return fail(path + " is not a checkpoint");
+	if (h.byte_order != byte_order_mark)
+		return fail(path + " was written with a different byte order");
+	if (h.version != version)
+		return fail(fmt::format("{} is checkpoint version {}, expected {}", path, h.version, version));
+	if (h.file_size > size or sizeof(checkpoint_format::header) + uint64_t(h.column_count) * sizeof(checkpoint_format::column) > size)
+		return fail(path + " is truncated");
+
+	auto const* const table = reinterpret_cast<checkpoint_format::column const*>(data + sizeof(checkpoint_format::header));
+	for (uint32_t c = 0; c < h.column_count; ++c) {
+		auto const& col = table[c];
+		if (col.offset % alignof(float) != 0 or col.offset + col.byte_size > size)
+			return fail(fmt::format("{} has a column outside the file", path));
+		if (col.element_size != sizeof(float) or col.byte_size != h.particle_count * sizeof(float))
+			return fail(fmt::format("{} has a column of the wrong size", path));
+	}
+
+	last_error.clear();
+	return true;
+}
+
+void mapped_checkpoint::close() noexcept {
+	if (!data)
+		return;
+
+#if defined(_WIN32)
+	UnmapViewOfFile(data);
+#else
+	munmap(const_cast<std::byte*>(data), size);
+#endif
+
+	data = nullptr;
+	size = 0;
+}
+
+std::span<float const> mapped_checkpoint::column(char const* name) const noexcept {
+	using namespace checkpoint_format;
+
+	if (!data)
+		return {};
+
+	auto const& h = header();
+	auto const* const table = reinterpret_cast<checkpoint_format::column const*>(data + sizeof(checkpoint_format::header));
+	for (uint32_t c = 0; c < h.column_count; ++c) {
+		if (std::strncmp(table[c].name, name, max_name_length) == 0)
+			return { reinterpret_cast<float const*>(data + table[c].offset), h.particle_count };
+	}
+
+	return {};
+}
+
+bool restore_checkpoint(simulation& sim, mapped_checkpoint const& checkpoint) {
+	auto const& h = checkpoint.header();
+
+	sim.manager = EntityManagerType();
+	auto const first = sim.manager.extend(h.particle_count);
+
+	for_each_component<checkpointed_components>::apply([&]<typename C>() {
+		auto const source = checkpoint.column(C::name);
+		if (source.empty())
+			return;
+		auto const destination = sim.manager.get_storage_for_component<C>();
+		std::copy(source.begin(), source.end(), destination.begin() + first);
+	});
+
+	partition_by_charge(sim.manager);
+	sim.species_registry = species_table();
+	assign_species(sim.manager, sim.species_registry);
+
+	sim.set_step_count(h.step);
+	sim.set_elapsed_time(h.time);
+	sim.particles_replaced();
+	return true;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "simulation.hpp"
+
+// Checkpoint file layout, all little endian:
+//
+//   checkpoint_format::header             64 bytes
+//   checkpoint_format::column[count]      48 bytes each
+//   column data, each starting at a multiple of alignment
+//
+// Every column holds particle_count elements in dense index order, exactly
+// like the in-memory columns, so loading is one copy per column out of a
+// mapped file. Columns are found by name, so columns can be added or
+// reordered without breaking old files; anything else bumps the version.
+namespace checkpoint_format {
+	inline constexpr char magic[8] = { '2', 'D', 'P', 'H', 'Y', 'S', 'C', 'K' };
+	inline constexpr uint32_t version = 1;
+	inline constexpr uint32_t byte_order_mark = 0x01020304;
+	inline constexpr uint64_t alignment = 64;
+	inline constexpr size_t max_name_length = 24;
+
+	struct header {
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+		uint64_t particle_count;
+		uint64_t step;
+		double time;
+		uint32_t column_count;
+		uint32_t alignment;
+		uint64_t file_size;
+		uint64_t reserved;
+	};
+
+	struct column {
+		char name[max_name_length];
+		uint32_t element_size;
+		uint32_t reserved;
+		uint64_t offset;
+		uint64_t byte_size;
+	};
+
+	static_assert(sizeof(header) == 64);
+	static_assert(sizeof(column) == 48);
+}
+
+// Everything a checkpoint needs, copied out of a simulation so it can be
+// written while the simulation keeps stepping.
+struct checkpoint_data {
+	uint64_t step = 0;
+	double time = 0.0;
+	size_t particle_count = 0;
+	std::vector<char const*> names;
+	std::vector<std::vector<float>> columns;
+};
+
+// Copies the physical columns and the clock. Must not race with step().
+void capture_checkpoint(simulation const& sim, checkpoint_data& data);
+
+// Writes to a temporary file next to path, syncs it to disk and renames it
+// into place, then syncs the directory, so neither a crash nor a power loss
+// mid-write leaves less than the previous checkpoint. Windows cannot sync
+// the directory, so there a power loss may still lose the rename.
+bool write_checkpoint(std::string const& path, checkpoint_data const& data);
+
+// Writes checkpoints on a background thread. If a save is requested while
+// one is being written, only the newest pending one is kept.
+class checkpoint_writer {
+public:
+	checkpoint_writer();
+	~checkpoint_writer();
+
+	checkpoint_writer(checkpoint_writer const&) = delete;
+	checkpoint_writer& operator=(checkpoint_writer const&) = delete;
+
+	// Captures sim now, on the calling thread, and writes it later.
+	void save_async(simulation const& sim, std::string path);
+
+	// Blocks until nothing is pending or being written.
+	void wait();
+
+private:
+	void loop(std::stop_token stop);
+
+	std::mutex lock;
+	std::condition_variable_any work_changed;
+	std::optional<std::pair<std::string, checkpoint_data>> pending;
+	bool writing;
+
+	// Buffers of a finished save, reused by the next capture so periodic
+	// saves settle into no allocation.
+	checkpoint_data spare;
+
+	std::jthread worker;
+};
+
+// A checkpoint file mapped read-only. Columns are views straight into the
+// mapping and stay valid for the lifetime of the object.
+class mapped_checkpoint {
+public:
+	mapped_checkpoint() = default;
+	~mapped_checkpoint();
+
+	mapped_checkpoint(mapped_checkpoint&& other) noexcept;
+	mapped_checkpoint& operator=(mapped_checkpoint&& other) noexcept;
+	mapped_checkpoint(mapped_checkpoint const&) = delete;
+	mapped_checkpoint& operator=(mapped_checkpoint const&) = delete;
+
+	// Maps and validates path. On failure returns false and error() says why.
+	bool open(std::string const& path);
+	void close() noexcept;
+
+	std::string const& error() const noexcept {
+		return last_error;
+	}
+
+	checkpoint_format::header const& header() const noexcept {
+		return *reinterpret_cast<checkpoint_format::header const*>(data);
+	}
+
+	// Empty if the file has no column of that name.
+	std::span<float const> column(char const* name) const noexcept;
+
+private:
+	bool fail(std::string message);
+
+	std::byte const* data = nullptr;
+	size_t size = 0;
+	std::string last_error;
+};
+
+// Replaces every particle in sim with the checkpoint's and restores the
+// clock. Columns missing from the file are left zero. Must not race with
+// step().
+bool restore_checkpoint(simulation& sim, mapped_checkpoint const& checkpoint);
@@ -0,0 +1,92 @@
+// Built with AVX2 + FMA enabled (see CMakeLists.txt) and only called after
+// best_simd_level() has checked the CPU, so keep everything in here free of
+// inline library code that could be shared with other translation units.
+
+#include "direct_sum_kernels.hpp"
+
+#if defined(PHYSICS_X86_KERNELS)
+
+#include <immintrin.h>
+
+namespace kernels {
+
+	namespace {
+		struct block_sums {
+			__m256 fx;
+			__m256 fy;
+		};
+
+		// One block of 8 j against i, with Coulomb only when Charged. Lanes
+		// with r == 0 (i itself) get a zero inverse distance.
+		template<bool Charged>
+		inline block_sums interact(particle_arrays const& p, size_t j, __m256 xi, __m256 yi, __m256 gi, __m256 ki, block_sums sums) noexcept {
+			auto const half = _mm256_set1_ps(0.5f);
+			auto const three_halves = _mm256_set1_ps(1.5f);
+
+			auto const dx = _mm256_sub_ps(_mm256_loadu_ps(p.x + j), xi);
+			auto const dy = _mm256_sub_ps(_mm256_loadu_ps(p.y + j), yi);
+			auto const r2 = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+
+			// rsqrt is good to ~12 bits, one Newton step brings it to ~23.
+			auto inv_r = _mm256_rsqrt_ps(r2);
+			inv_r = _mm256_mul_ps(inv_r, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(inv_r, inv_r), three_halves));
+			inv_r = _mm256_and_ps(inv_r, _mm256_cmp_ps(r2, _mm256_setzero_ps(), _CMP_GT_OQ));
+
+			auto const inv_r3 = _mm256_mul_ps(inv_r, _mm256_mul_ps(inv_r, inv_r));
+			auto const coupling = Charged
+				? _mm256_fmadd_ps(gi, _mm256_loadu_ps(p.mass + j), _mm256_mul_ps(ki, _mm256_loadu_ps(p.charge + j)))
+				: _mm256_mul_ps(gi, _mm256_loadu_ps(p.mass + j));
+			auto const s = _mm256_mul_ps(coupling, inv_r3);
+
+			return block_sums{ _mm256_fmadd_ps(s, dx, sums.fx), _mm256_fmadd_ps(s, dy, sums.fy) };
+		}
+
+		// The blocks from j up to last, a multiple of 8 away, two at a time.
+		template<bool Charged>
+		inline size_t sweep(particle_arrays const& p, size_t j, size_t last, __m256 xi, __m256 yi, __m256 gi, __m256 ki, block_sums& even, block_sums& odd) noexcept {
+			// Two independent accumulators keep the FMA pipes busy instead
+			// of waiting on one dependency chain.
+			for (; j + 16 <= last; j += 16) {
+				even = interact<Charged>(p, j, xi, yi, gi, ki, even);
+				odd = interact<Charged>(p, j + 8, xi, yi, gi, ki, odd);
+			}
+			if (j < last) {
+				even = interact<Charged>(p, j, xi, yi, gi, ki, even);
+				j += 8;
+			}
+			return j;
+		}
+	}
+
+	void direct_sum_avx2(particle_arrays const& p, size_t first, size_t last) noexcept {
+		auto const full_blocks = p.size - p.size % 8;
+
+		for (auto i = first; i < last; ++i) {
+			auto const xi = _mm256_set1_ps(p.x[i]);
+			auto const yi = _mm256_set1_ps(p.y[i]);
+			auto const gi = _mm256_set1_ps(g * p.mass[i]);
+			auto const ki = _mm256_set1_ps(k * p.charge[i]);
+
+			block_sums even{ _mm256_setzero_ps(), _mm256_setzero_ps() };
+			block_sums odd{ _mm256_setzero_ps(), _mm256_setzero_ps() };
+
+			auto j = sweep<true>(p, 0, charged_blocks_end(p, i, 8, full_blocks), xi, yi, gi, ki, even, odd);
+			j = sweep<false>(p, j, full_blocks, xi, yi, gi, ki, even, odd);
+
+			auto const fx = _mm256_add_ps(even.fx, odd.fx);
+			auto const fy = _mm256_add_ps(even.fy, odd.fy);
+			auto const fx4 = _mm_add_ps(_mm256_castps256_ps128(fx), _mm256_extractf128_ps(fx, 1));
+			auto const fy4 = _mm_add_ps(_mm256_castps256_ps128(fy), _mm256_extractf128_ps(fy, 1));
+			auto const sums = _mm_hadd_ps(_mm_hadd_ps(fx4, fy4), _mm_setzero_ps());
+
+			float sum_x = _mm_cvtss_f32(sums);
+			float sum_y = _mm_cvtss_f32(_mm_shuffle_ps(sums, sums, 1));
+			direct_sum_remainder(p, i, j, sum_x, sum_y);
+
+			p.fx[i] += sum_x;
+			p.fy[i] += sum_y;
+		}
+	}
+}
+
+#endif
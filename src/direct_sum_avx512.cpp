@@ -0,0 +1,90 @@
+// Built with AVX-512F enabled (see CMakeLists.txt) and only called after
+// best_simd_level() has checked the CPU, so keep everything in here free of
+// inline library code that could be shared with other translation units.
+
+#include "direct_sum_kernels.hpp"
+
+#if defined(PHYSICS_X86_KERNELS)
+
+#include <immintrin.h>
+
+namespace kernels {
+
+	namespace {
+		struct block_sums {
+			__m512 fx;
+			__m512 fy;
+		};
+
+		// One block of 16 j against i, with Coulomb only when Charged.
+		// Lanes outside `lanes` load zeros and so get a zero coupling, lanes
+		// with r == 0 (i itself) get a zero inverse distance.
+		template<bool Charged>
+		inline block_sums interact(particle_arrays const& p, size_t j, __mmask16 lanes, __m512 xi, __m512 yi, __m512 gi, __m512 ki, block_sums sums) noexcept {
+			auto const half = _mm512_set1_ps(0.5f);
+			auto const three_halves = _mm512_set1_ps(1.5f);
+
+			auto const dx = _mm512_sub_ps(_mm512_maskz_loadu_ps(lanes, p.x + j), xi);
+			auto const dy = _mm512_sub_ps(_mm512_maskz_loadu_ps(lanes, p.y + j), yi);
+			auto const r2 = _mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy));
+
+			// rsqrt14 plus one Newton step is accurate to full precision.
+			auto inv_r = _mm512_rsqrt14_ps(r2);
+			inv_r = _mm512_mul_ps(inv_r, _mm512_fnmadd_ps(_mm512_mul_ps(half, r2), _mm512_mul_ps(inv_r, inv_r), three_halves));
+
+			auto const valid = _mm512_mask_cmp_ps_mask(lanes, r2, _mm512_setzero_ps(), _CMP_GT_OQ);
+			inv_r = _mm512_maskz_mov_ps(valid, inv_r);
+
+			auto const inv_r3 = _mm512_mul_ps(inv_r, _mm512_mul_ps(inv_r, inv_r));
+			auto const coupling = Charged
+				? _mm512_fmadd_ps(gi, _mm512_maskz_loadu_ps(lanes, p.mass + j), _mm512_mul_ps(ki, _mm512_maskz_loadu_ps(lanes, p.charge + j)))
+				: _mm512_mul_ps(gi, _mm512_maskz_loadu_ps(lanes, p.mass + j));
+			auto const s = _mm512_mul_ps(coupling, inv_r3);
+
+			return block_sums{ _mm512_fmadd_ps(s, dx, sums.fx), _mm512_fmadd_ps(s, dy, sums.fy) };
+		}
+
+		// The j from j up to last.
+		template<bool Charged>
+		inline void sweep(particle_arrays const& p, size_t j, size_t last, __m512 xi, __m512 yi, __m512 gi, __m512 ki, block_sums& even, block_sums& odd) noexcept {
+			__mmask16 const all_lanes = 0xffff;
+
+			// Two independent accumulators keep the FMA pipes busy instead
+			// of waiting on one dependency chain.
+			for (; j + 32 <= last; j += 32) {
+				even = interact<Charged>(p, j, all_lanes, xi, yi, gi, ki, even);
+				odd = interact<Charged>(p, j + 16, all_lanes, xi, yi, gi, ki, odd);
+			}
+
+			// Masked loads handle the tail, so no scalar remainder here.
+			for (; j < last; j += 16) {
+				auto const remaining = last - j;
+				auto const lanes = remaining >= 16 ? all_lanes : static_cast<__mmask16>((1u << remaining) - 1);
+				even = interact<Charged>(p, j, lanes, xi, yi, gi, ki, even);
+			}
+		}
+	}
+
+	void direct_sum_avx512(particle_arrays const& p, size_t first, size_t last) noexcept {
+		for (auto i = first; i < last; ++i) {
+			auto const xi = _mm512_set1_ps(p.x[i]);
+			auto const yi = _mm512_set1_ps(p.y[i]);
+			auto const gi = _mm512_set1_ps(g * p.mass[i]);
+			auto const ki = _mm512_set1_ps(k * p.charge[i]);
+
+			block_sums even{ _mm512_setzero_ps(), _mm512_setzero_ps() };
+			block_sums odd{ _mm512_setzero_ps(), _mm512_setzero_ps() };
+
+			// Masked blocks let the Coulomb term stop right at the last pair
+			// that needs it.
+			auto const charged = charged_end(p, i);
+			sweep<true>(p, 0, charged, xi, yi, gi, ki, even, odd);
+			sweep<false>(p, charged, p.size, xi, yi, gi, ki, even, odd);
+
+			p.fx[i] += _mm512_reduce_add_ps(_mm512_add_ps(even.fx, odd.fx));
+			p.fy[i] += _mm512_reduce_add_ps(_mm512_add_ps(even.fy, odd.fy));
+		}
+	}
+}
+
+#endif
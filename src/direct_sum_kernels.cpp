@@ -0,0 +1,199 @@
+#include "direct_sum_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(PHYSICS_X86_KERNELS)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+
+	struct cpu_features {
+		bool sse2 = false;
+		bool avx2 = false;
+		bool avx512 = false;
+	};
+
+	cpu_features detect_cpu_features() noexcept {
+		cpu_features features;
+
+#if defined(PHYSICS_X86_KERNELS)
+#if defined(_MSC_VER)
+		int regs[4];
+		__cpuid(regs, 0);
+		auto const max_leaf = regs[0];
+
+		__cpuid(regs, 1);
+		features.sse2 = (regs[3] & (1 << 26)) != 0;
+		auto const fma = (regs[2] & (1 << 12)) != 0;
+		auto const os_saves_ymm = (regs[2] & (1 << 27)) != 0 and (_xgetbv(0) & 0x6) == 0x6;
+		auto const os_saves_zmm = os_saves_ymm and (_xgetbv(0) & 0xe6) == 0xe6;
+
+		if (max_leaf >= 7) {
+			__cpuidex(regs, 7, 0);
+			features.avx2 = os_saves_ymm and fma and (regs[1] & (1 << 5)) != 0;
+			features.avx512 = os_saves_zmm and fma and (regs[1] & (1 << 16)) != 0;
+		}
+#else
+		__builtin_cpu_init();
+		features.sse2 = __builtin_cpu_supports("sse2");
+		features.avx2 = __builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma");
+		features.avx512 = __builtin_cpu_supports("avx512f") and __builtin_cpu_supports("fma");
+#endif
+#endif
+
+		return features;
+	}
+}
+
+char const* simd_level_name(simd_level level) noexcept {
+	switch (level) {
+	case simd_level::sse2:
+		return "SSE2";
+	case simd_level::avx2:
+		return "AVX2";
+	case simd_level::avx512:
+		return "AVX-512";
+	default:
+		return "scalar";
+	}
+}
+
+simd_level best_simd_level() noexcept {
+	static cpu_features const features = detect_cpu_features();
+
+	if (features.avx512)
+		return simd_level::avx512;
+	if (features.avx2)
+		return simd_level::avx2;
+	if (features.sse2)
+		return simd_level::sse2;
+	return simd_level::scalar;
+}
+
+direct_sum_kernel get_direct_sum_kernel(simd_level level) noexcept {
+	auto const best = best_simd_level();
+	if (static_cast<int>(level) > static_cast<int>(best))
+		level = best;
+
+	switch (level) {
+#if defined(PHYSICS_X86_KERNELS)
+	case simd_level::avx512:
+		return kernels::direct_sum_avx512;
+	case simd_level::avx2:
+		return kernels::direct_sum_avx2;
+	case simd_level::sse2:
+		return kernels::direct_sum_sse2;
+#endif
+	default:
+		return kernels::direct_sum_scalar;
+	}
+}
+
+namespace kernels {
+
+	size_t charged_end(particle_arrays const& p, size_t i) noexcept {
+		return i < p.charged_count() ? p.charged_count() : 0;
+	}
+
+	size_t charged_blocks_end(particle_arrays const& p, size_t i, size_t width, size_t full_blocks) noexcept {
+		return std::min(full_blocks, (charged_end(p, i) + width - 1) / width * width);
+	}
+
+	void direct_sum_remainder(particle_arrays const& p, size_t i, size_t j_begin, float& fx, float& fy) noexcept {
+		auto const xi = p.x[i];
+		auto const yi = p.y[i];
+		auto const gi = g * p.mass[i];
+		auto const ki = k * p.charge[i];
+
+		auto const add = [&](size_t j, float coupling) {
+			auto const dx = p.x[j] - xi;
+			auto const dy = p.y[j] - yi;
+			auto const r2 = dx * dx + dy * dy;
+
+			// Also skips i itself.
+			if (r2 == 0.f)
+				return;
+
+			auto const inv_r = 1.f / std::sqrt(r2);
+			auto const s = coupling * (inv_r * inv_r * inv_r);
+			fx += s * dx;
+			fy += s * dy;
+		};
+
+		auto j = j_begin;
+		for (auto const charged = charged_end(p, i); j < charged; ++j)
+			add(j, gi * p.mass[j] + ki * p.charge[j]);
+		for (; j < p.size; ++j)
+			add(j, gi * p.mass[j]);
+	}
+
+	void direct_sum_scalar(particle_arrays const& p, size_t first, size_t last) noexcept {
+		for (auto i = first; i < last; ++i) {
+			float fx = 0.f;
+			float fy = 0.f;
+			direct_sum_remainder(p, i, 0, fx, fy);
+			p.fx[i] += fx;
+			p.fy[i] += fy;
+		}
+	}
+
+#if defined(PHYSICS_X86_KERNELS)
+	// SSE2 is part of x86-64, so this one needs no special compile flags.
+	void direct_sum_sse2(particle_arrays const& p, size_t first, size_t last) noexcept {
+		auto const half = _mm_set1_ps(0.5f);
+		auto const three_halves = _mm_set1_ps(1.5f);
+		auto const zero = _mm_setzero_ps();
+		auto const full_blocks = p.size - p.size % 4;
+
+		for (auto i = first; i < last; ++i) {
+			auto const xi = _mm_set1_ps(p.x[i]);
+			auto const yi = _mm_set1_ps(p.y[i]);
+			auto const gi = _mm_set1_ps(g * p.mass[i]);
+			auto const ki = _mm_set1_ps(k * p.charge[i]);
+
+			auto fx = _mm_setzero_ps();
+			auto fy = _mm_setzero_ps();
+
+			auto const add = [&](size_t j, __m128 coupling) {
+				auto const dx = _mm_sub_ps(_mm_loadu_ps(p.x + j), xi);
+				auto const dy = _mm_sub_ps(_mm_loadu_ps(p.y + j), yi);
+				auto const r2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+				// rsqrt is good to ~12 bits, one Newton step brings it to ~23.
+				auto inv_r = _mm_rsqrt_ps(r2);
+				inv_r = _mm_mul_ps(inv_r, _mm_sub_ps(three_halves, _mm_mul_ps(_mm_mul_ps(half, r2), _mm_mul_ps(inv_r, inv_r))));
+				inv_r = _mm_and_ps(inv_r, _mm_cmpgt_ps(r2, zero));
+
+				auto const inv_r3 = _mm_mul_ps(inv_r, _mm_mul_ps(inv_r, inv_r));
+				auto const s = _mm_mul_ps(coupling, inv_r3);
+
+				fx = _mm_add_ps(fx, _mm_mul_ps(s, dx));
+				fy = _mm_add_ps(fy, _mm_mul_ps(s, dy));
+			};
+
+			size_t j = 0;
+			for (auto const charged = charged_blocks_end(p, i, 4, full_blocks); j < charged; j += 4)
+				add(j, _mm_add_ps(_mm_mul_ps(gi, _mm_loadu_ps(p.mass + j)), _mm_mul_ps(ki, _mm_loadu_ps(p.charge + j))));
+			for (; j < full_blocks; j += 4)
+				add(j, _mm_mul_ps(gi, _mm_loadu_ps(p.mass + j)));
+
+			alignas(16) float lanes_x[4];
+			alignas(16) float lanes_y[4];
+			_mm_store_ps(lanes_x, fx);
+			_mm_store_ps(lanes_y, fy);
+
+			float sum_x = (lanes_x[0] + lanes_x[1]) + (lanes_x[2] + lanes_x[3]);
+			float sum_y = (lanes_y[0] + lanes_y[1]) + (lanes_y[2] + lanes_y[3]);
+			direct_sum_remainder(p, i, full_blocks, sum_x, sum_y);
+
+			p.fx[i] += sum_x;
+			p.fy[i] += sum_y;
+		}
+	}
+#endif
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+
+#include "particle_arrays.hpp"
+
+// Explicitly vectorized all-pairs gravity + Coulomb. Each kernel walks
+// i in [first, last) and sums over blocks of j in [0, p.size) without using
+// Newton's third law, so it only writes p.fx[i] and p.fy[i] and blocks of i
+// can run on different threads with no coordination at all. The couplings
+// are folded into one g*mi*mj + k*qi*qj term times a single rsqrt-based
+// inverse cube, or just g*mi*mj for pairs past the charged particles (see
+// particle_arrays::charged).
+enum class simd_level {
+	scalar,
+	sse2,
+	avx2,
+	avx512
+};
+
+char const* simd_level_name(simd_level level) noexcept;
+
+// Widest level that was compiled in and that the CPU we are running on
+// supports.
+simd_level best_simd_level() noexcept;
+
+using direct_sum_kernel = void (*)(particle_arrays const& p, size_t first, size_t last) noexcept;
+
+// Falls back to the next narrower level if the requested one is unavailable.
+direct_sum_kernel get_direct_sum_kernel(simd_level level) noexcept;
+
+namespace kernels {
+	void direct_sum_scalar(particle_arrays const& p, size_t first, size_t last) noexcept;
+	void direct_sum_sse2(particle_arrays const& p, size_t first, size_t last) noexcept;
+	void direct_sum_avx2(particle_arrays const& p, size_t first, size_t last) noexcept;
+	void direct_sum_avx512(particle_arrays const& p, size_t first, size_t last) noexcept;
+
+	// Scalar tail shared by the vector kernels: adds the force on i from
+	// j in [j_begin, p.size). Deliberately out of line so nothing compiled
+	// with wider instruction sets can leak into the baseline code through
+	// an inline function.
+	void direct_sum_remainder(particle_arrays const& p, size_t i, size_t j_begin, float& fx, float& fy) noexcept;
+
+	// Where the pairs of i that need charge end: after the charged
+	// particles for a charged i, at 0 for a neutral one. The second rounds
+	// that up to whole blocks of width j, at most full_blocks.
+	size_t charged_end(particle_arrays const& p, size_t i) noexcept;
+	size_t charged_blocks_end(particle_arrays const& p, size_t i, size_t width, size_t full_blocks) noexcept;
+}
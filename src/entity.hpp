@@ -1,11 +1,15 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <memory>
 #include <optional>
+#include <span>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "aligned_allocator.hpp"
 #include "TypeList.hpp"
 #include "tuple_of_optionals.hpp"
 
@@ -27,7 +31,7 @@ public:
 
 	size_t id;
 
-	Entity(typename ArgsTypeList::template apply_to_each<typename std::optional>::as_tuple && initializer_data)
+	Entity(typename ArgsTypeList::template apply_to_each<std::optional>::as_tuple && initializer_data)
 		: id(0), storage(std::move(initializer_data)) {
 
 	}
@@ -141,8 +145,8 @@ private:
 	// I finally got a chance to use generic lambdas
 	// Woe is me
 		auto maybe_push_back_component_address = [this] <typename T> (auto & entity, auto & storage_for_T) mutable -> void {
-			if (entity.get_component<T>() != nullptr) {
-				storage_for_T.push_back(entity.get_component<T>());
+			if (entity.template get_component<T>() != nullptr) {
+				storage_for_T.push_back(entity.template get_component<T>());
 			}
 
 		};
@@ -168,3 +172,203 @@ private:
 	typename std::vector<std::unique_ptr<Entity_t>> entity_storage;
 	typename ListsViaTypes::TypeList<ComponentTypes...>::template apply_to_each<std::add_pointer_t>::template apply_to_each<ContainerModel>::as_tuple storage;
 };
+
+
+// A component may name a different type to store in its column, which lets
+// tag types like `struct PositionX { using column_type = float; };` split an
+// aggregate into one dense array per field.
+template<typename T>
+struct column_type_of {
+	using type = T;
+};
+
+template<typename T>
+	requires requires { typename T::column_type; }
+struct column_type_of<T> {
+	using type = typename T::column_type;
+};
+
+template<typename T>
+using column_type_t = typename column_type_of<T>::type;
+
+
+// EntityManager via columns: structure-of-arrays storage where every
+// component lives in its own contiguous, aligned column and an entity is
+// just a dense index shared by all columns. Entities are referred to by
+// handles, which stay valid while other entities come and go even though
+// the dense indices get shuffled.
+template<typename ComponentTypeList, size_t Alignment = 64>
+class ColumnarEntityManager;
+
+template<typename ... ComponentTypes, size_t Alignment>
+class ColumnarEntityManager<ListsViaTypes::TypeList<ComponentTypes...>, Alignment> {
+public:
+	using ArgsTypeList = TypeList<ComponentTypes...>;
+	using ThisType = ColumnarEntityManager<ArgsTypeList, Alignment>;
+
+	template<typename T>
+	using column_t = std::vector<column_type_t<T>, aligned_allocator<column_type_t<T>, Alignment>>;
+
+	struct handle {
+		uint32_t slot;
+		uint32_t generation;
+
+		bool operator==(handle const&) const = default;
+	};
+
+	ColumnarEntityManager() = default;
+
+	void reserve(size_t desired_capacity) {
+		handles.reserve(desired_capacity);
+		(get_column<ComponentTypes>().reserve(desired_capacity), ...);
+	}
+
+	size_t size() const noexcept {
+		return handles.size();
+	}
+
+	// One value per component, in TypeList order.
+	handle push_back(column_type_t<ComponentTypes> ... values) {
+		auto const new_handle = allocate_handle();
+
+		(get_column<ComponentTypes>().push_back(std::move(values)), ...);
+
+		return new_handle;
+	}
+
+	// Appends count entities with value-initialized components and returns
+	// the dense index of the first, so bulk loads can fill whole columns.
+	size_t extend(size_t count) {
+		auto const first = size();
+		handles.reserve(first + count);
+
+		for (size_t k = 0; k < count; ++k)
+			allocate_handle();
+
+		(get_column<ComponentTypes>().resize(first + count), ...);
+
+		return first;
+	}
+
+	// Moves the last entity into the hole, so erasing is O(1) per column.
+	void erase(handle h) {
+		if (!contains(h))
+			return;
+
+		auto const index = dense_index[h.slot];
+		auto const last = size() - 1;
+
+		(move_and_pop<ComponentTypes>(index, last), ...);
+
+		auto const moved = handles[last];
+		handles[index] = moved;
+		handles.pop_back();
+		dense_index[moved.slot] = index;
+
+		++generations[h.slot];
+		free_slots.push_back(h.slot);
+	}
+
+	// Swaps the entities at dense indices a and b, components and handles
+	// alike, so stores can keep their entities in whatever order suits them.
+	void swap_entities(size_t a, size_t b) {
+		if (a == b)
+			return;
+
+		(swap_in_column<ComponentTypes>(a, b), ...);
+
+		std::swap(handles[a], handles[b]);
+		dense_index[handles[a].slot] = static_cast<uint32_t>(a);
+		dense_index[handles[b].slot] = static_cast<uint32_t>(b);
+	}
+
+	bool contains(handle h) const noexcept {
+		return h.slot < generations.size() and generations[h.slot] == h.generation;
+	}
+
+	size_t index_of(handle h) const noexcept {
+		return dense_index[h.slot];
+	}
+
+	handle handle_of(size_t index) const noexcept {
+		return handles[index];
+	}
+
+	template<typename T>
+	std::span<column_type_t<T> const> get_storage_for_component() const noexcept {
+		static_assert(ArgsTypeList::template contains<T>(), "ColumnarEntityManager::get_storage_for_component called on type not in TypeList.");
+
+		return get_column<T>();
+	}
+
+	template<typename T>
+	std::span<column_type_t<T>> get_storage_for_component() noexcept {
+		static_assert(ArgsTypeList::template contains<T>(), "ColumnarEntityManager::get_storage_for_component called on type not in TypeList.");
+
+		return get_column<T>();
+	}
+
+	template<typename T>
+	column_type_t<T>& get_component(handle h) noexcept {
+		return get_column<T>()[index_of(h)];
+	}
+
+	template<typename T>
+	column_type_t<T> const& get_component(handle h) const noexcept {
+		return get_column<T>()[index_of(h)];
+	}
+
+private:
+	// Registers one more entity at dense index size(). The caller appends
+	// its components.
+	handle allocate_handle() {
+		uint32_t slot;
+		if (free_slots.empty()) {
+			slot = static_cast<uint32_t>(dense_index.size());
+			dense_index.push_back(0);
+			generations.push_back(0);
+		}
+		else {
+			slot = free_slots.back();
+			free_slots.pop_back();
+		}
+
+		auto const new_handle = handle{ slot, generations[slot] };
+		dense_index[slot] = static_cast<uint32_t>(size());
+		handles.push_back(new_handle);
+
+		return new_handle;
+	}
+
+	// Columns can share a value type, so look them up by position.
+	template<typename T>
+	column_t<T>& get_column() noexcept {
+		return std::get<ArgsTypeList::template get_index_of<T>()>(storage);
+	}
+
+	template<typename T>
+	column_t<T> const& get_column() const noexcept {
+		return std::get<ArgsTypeList::template get_index_of<T>()>(storage);
+	}
+
+	template<typename T>
+	void move_and_pop(size_t index, size_t last) {
+		auto& column = get_column<T>();
+		if (index != last)
+			column[index] = std::move(column[last]);
+		column.pop_back();
+	}
+
+	template<typename T>
+	void swap_in_column(size_t a, size_t b) {
+		auto& column = get_column<T>();
+		std::swap(column[a], column[b]);
+	}
+
+	std::tuple<column_t<ComponentTypes>...> storage;
+
+	std::vector<handle> handles;
+	std::vector<uint32_t> dense_index;
+	std::vector<uint32_t> generations;
+	std::vector<uint32_t> free_slots;
+};
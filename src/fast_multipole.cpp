@@ -0,0 +1,450 @@
+#include "fast_multipole.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+	// binom(x, k) for any real x.
+	double generalized_choose(double x, unsigned k) noexcept {
+		double result = 1.0;
+		for (unsigned j = 0; j < k; ++j)
+			result *= (x - j) / (j + 1);
+		return result;
+	}
+
+	using complex = std::complex<double>;
+
+	// a b and a conj(b) in real arithmetic, as the complex product checks
+	// for infinities on every multiply, which keeps the translations from
+	// vectorizing.
+	inline complex times(complex a, complex b) noexcept {
+		return { a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real() };
+	}
+
+	inline complex times_conj(complex a, complex b) noexcept {
+		return { a.real() * b.real() + a.imag() * b.imag(), a.imag() * b.real() - a.real() * b.imag() };
+	}
+
+	// z^0 .. z^(count - 1).
+	void powers(complex z, complex* out, size_t count) noexcept {
+		complex power(1);
+		for (size_t n = 0; n < count; ++n) {
+			out[n] = power;
+			power = times(power, z);
+		}
+	}
+
+}
+
+double fast_multipole::error_bound(settings const& options) noexcept {
+	auto const theta = static_cast<double>(std::clamp(options.separation, 0.f, 0.99f));
+	auto const p = std::min(options.order, max_order);
+	return 2.0 * std::pow(theta, p + 1) / ((1.0 - theta) * (1.0 - theta));
+}
+
+void fast_multipole::build(thread_pool& pool, particle_arrays const& particles, settings const& options) {
+	auto const n = particles.size;
+
+	if (std::min(options.order, max_order) != order or terms == 0) {
+		order = std::min(options.order, max_order);
+		width = order + 1;
+		terms = width * width;
+
+		choose.assign(terms, 0.0);
+		m2l_factors.assign(terms, 0.0);
+		for (unsigned a = 0; a <= order; ++a) {
+			for (unsigned k = 0; k <= order; ++k) {
+				choose[a * width + k] = k <= a ? generalized_choose(a, k) : 0.0;
+				m2l_factors[a * width + k] = generalized_choose(-0.5, a) * (a % 2 == 0 ? 1.0 : -1.0) * generalized_choose(-0.5 - a, k);
+			}
+		}
+	}
+	separation = std::clamp(static_cast<double>(options.separation), 0.0, 0.99);
+
+	nodes.clear();
+	for (auto& level : levels)
+		level.clear();
+	order_of.resize(n);
+	leaf_of.resize(n);
+	masses.resize(n);
+	charges.resize(n);
+
+	if (n == 0)
+		return;
+
+	float min_x = std::numeric_limits<float>::max();
+	float min_y = std::numeric_limits<float>::max();
+	float max_x = std::numeric_limits<float>::lowest();
+	float max_y = std::numeric_limits<float>::lowest();
+	for (size_t i = 0; i < n; ++i) {
+		order_of[i] = static_cast<uint32_t>(i);
+		min_x = std::min(min_x, particles.x[i]);
+		min_y = std::min(min_y, particles.y[i]);
+		max_x = std::max(max_x, particles.x[i]);
+		max_y = std::max(max_y, particles.y[i]);
+	}
+
+	// Positions in particle order for partitioning, rewritten in tree order
+	// once the tree is built.
+	xs.assign(particles.x, particles.x + n);
+	ys.assign(particles.y, particles.y + n);
+
+	auto const half_width = 0.5 * std::max(max_x - min_x, max_y - min_y) * 1.001 + 1e-3;
+	nodes.push_back({ 0.5 * (min_x + max_x), 0.5 * (min_y + max_y), half_width, 0.0, 0, n, no_children, no_children });
+	if (levels.empty())
+		levels.resize(1);
+	levels[0].push_back(0);
+	split_node(0, 0);
+
+	for (size_t s = 0; s < n; ++s) {
+		auto const i = order_of[s];
+		xs[s] = particles.x[i];
+		ys[s] = particles.y[i];
+		masses[s] = particles.mass[i];
+		charges[s] = particles.charge[i];
+	}
+
+	multipoles.assign(nodes.size() * sources * terms, {});
+	locals.assign(nodes.size() * sources * terms, {});
+
+	// Upward: leaves from their particles, the rest from their children,
+	// deepest level first so children are done before their parents.
+	for (auto level = levels.size(); level-- > 0;) {
+		pool.for_each(levels[level], [this](size_t b) {
+			auto& box = nodes[b];
+			if (box.first_child == no_children) {
+				particles_to_multipole(b);
+				return;
+			}
+
+			box.radius = 0.0;
+			for (auto c = box.first_child; c < box.first_child + 4; ++c) {
+				auto const& child = nodes[c];
+				if (child.begin == child.end)
+					continue;
+				multipole_to_multipole(c, b);
+				box.radius = std::max(box.radius, child.radius + std::hypot(child.center_x - box.center_x, child.center_y - box.center_y));
+			}
+		}, 1);
+	}
+
+	far_boxes.resize(nodes.size());
+	near_boxes.resize(nodes.size());
+	for (auto& boxes : far_boxes)
+		boxes.clear();
+	for (auto& boxes : near_boxes)
+		boxes.clear();
+	pair_within(0);
+
+	// Downward: each box's local expansion is its parent's, shifted to its
+	// center, plus those of the boxes far enough away, top level first.
+	for (auto const& level : levels) {
+		pool.for_each(level, [this](size_t b) {
+			thread_local std::vector<complex> scratch;
+			scratch.resize(2 * terms);
+
+			if (nodes[b].parent != no_children)
+				local_to_local(nodes[b].parent, b, scratch);
+			for (auto const source : far_boxes[b])
+				multipole_to_local(source, b, scratch);
+		}, 1);
+	}
+}
+
+void fast_multipole::split_node(size_t index, size_t depth) {
+	auto const begin = nodes[index].begin;
+	auto const end = nodes[index].end;
+	if (end - begin <= leaf_capacity or depth == max_depth) {
+		for (auto s = begin; s < end; ++s)
+			leaf_of[order_of[s]] = static_cast<uint32_t>(index);
+		return;
+	}
+
+	// Same quadrant order as barnes_hut_tree: left/right, then bottom/top.
+	auto const center_x = nodes[index].center_x;
+	auto const center_y = nodes[index].center_y;
+	auto const first = order_of.begin() + begin;
+	auto const last = order_of.begin() + end;
+	auto const split_x = std::partition(first, last, [&](uint32_t i) { return xs[i] < center_x; });
+	auto const split_lower = std::partition(first, split_x, [&](uint32_t i) { return ys[i] < center_y; });
+	auto const split_upper = std::partition(split_x, last, [&](uint32_t i) { return ys[i] < center_y; });
+
+	size_t const bounds[5] = {
+		begin,
+		static_cast<size_t>(split_lower - order_of.begin()),
+		static_cast<size_t>(split_x - order_of.begin()),
+		static_cast<size_t>(split_upper - order_of.begin()),
+		end
+	};
+
+	auto const quarter = 0.5 * nodes[index].half_width;
+	double const child_x[4] = { center_x - quarter, center_x - quarter, center_x + quarter, center_x + quarter };
+	double const child_y[4] = { center_y - quarter, center_y + quarter, center_y - quarter, center_y + quarter };
+
+	auto const first_child = nodes.size();
+	nodes[index].first_child = first_child;
+	if (levels.size() < depth + 2)
+		levels.resize(depth + 2);
+	for (size_t c = 0; c < 4; ++c) {
+		nodes.push_back({ child_x[c], child_y[c], quarter, 0.0, bounds[c], bounds[c + 1], no_children, index });
+		levels[depth + 1].push_back(first_child + c);
+	}
+
+	for (size_t c = 0; c < 4; ++c)
+		split_node(first_child + c, depth + 1);
+}
+
+void fast_multipole::pair_boxes(size_t a, size_t b) {
+	auto const& box_a = nodes[a];
+	auto const& box_b = nodes[b];
+	auto const distance = std::hypot(box_a.center_x - box_b.center_x, box_a.center_y - box_b.center_y);
+
+	if (box_a.radius + box_b.radius < separation * distance) {
+		far_boxes[a].push_back(static_cast<uint32_t>(b));
+		far_boxes[b].push_back(static_cast<uint32_t>(a));
+		return;
+	}
+
+	auto const a_leaf = box_a.first_child == no_children;
+	auto const b_leaf = box_b.first_child == no_children;
+	if (a_leaf and b_leaf) {
+		near_boxes[a].push_back(static_cast<uint32_t>(b));
+		near_boxes[b].push_back(static_cast<uint32_t>(a));
+		return;
+	}
+
+	// Open the larger box, or the one that can be.
+	auto const open_a = b_leaf or (not a_leaf and box_a.radius >= box_b.radius);
+	auto const opened = open_a ? a : b;
+	auto const other = open_a ? b : a;
+	for (auto c = nodes[opened].first_child; c < nodes[opened].first_child + 4; ++c) {
+		if (nodes[c].begin != nodes[c].end)
+			pair_boxes(c, other);
+	}
+}
+
+void fast_multipole::pair_within(size_t a) {
+	if (nodes[a].first_child == no_children) {
+		near_boxes[a].push_back(static_cast<uint32_t>(a));
+		return;
+	}
+
+	auto const first_child = nodes[a].first_child;
+	for (auto c = first_child; c < first_child + 4; ++c) {
+		if (nodes[c].begin == nodes[c].end)
+			continue;
+		pair_within(c);
+		for (auto d = c + 1; d < first_child + 4; ++d) {
+			if (nodes[d].begin != nodes[d].end)
+				pair_boxes(c, d);
+		}
+	}
+}
+
+void fast_multipole::particles_to_multipole(size_t n) {
+	auto& box = nodes[n];
+	auto* const mass = multipole(n, 0);
+	auto* const charge = multipole(n, 1);
+
+	thread_local std::vector<complex> powers_of_t;
+	powers_of_t.resize(width);
+
+	box.radius = 0.0;
+	for (auto s = box.begin; s < box.end; ++s) {
+		auto const t = complex(xs[s] - box.center_x, ys[s] - box.center_y);
+		box.radius = std::max(box.radius, std::abs(t));
+		powers(t, powers_of_t.data(), width);
+
+		for (size_t a = 0; a < width; ++a) {
+			for (size_t b = 0; b < width; ++b) {
+				auto const term = times_conj(powers_of_t[a], powers_of_t[b]);
+				mass[a * width + b] += static_cast<double>(masses[s]) * term;
+				charge[a * width + b] += static_cast<double>(charges[s]) * term;
+			}
+		}
+	}
+}
+
+void fast_multipole::multipole_to_multipole(size_t child, size_t parent) {
+	thread_local std::vector<complex> scratch;
+	scratch.resize(width + terms);
+	auto* const shift = scratch.data();
+	auto* const half = scratch.data() + width;
+
+	// t about the parent is t about the child plus delta; expanding
+	// (t + delta)^a and its conjugate shifts each index in turn.
+	auto const delta = complex(nodes[child].center_x - nodes[parent].center_x, nodes[child].center_y - nodes[parent].center_y);
+	powers(delta, shift, width);
+
+	for (size_t source = 0; source < sources; ++source) {
+		auto const* const from = multipole(child, source);
+		auto* const to = multipole(parent, source);
+
+		for (size_t a = 0; a < width; ++a) {
+			for (size_t b = 0; b < width; ++b) {
+				complex sum{};
+				for (size_t k = 0; k <= a; ++k)
+					sum += choose[a * width + k] * times(shift[a - k], from[k * width + b]);
+				half[a * width + b] = sum;
+			}
+		}
+		for (size_t a = 0; a < width; ++a) {
+			for (size_t b = 0; b < width; ++b) {
+				complex sum{};
+				for (size_t k = 0; k <= b; ++k)
+					sum += choose[b * width + k] * times_conj(half[a * width + k], shift[b - k]);
+				to[a * width + b] += sum;
+			}
+		}
+	}
+}
+
+void fast_multipole::multipole_to_local(size_t source, size_t target, std::vector<complex>& scratch) {
+	// With D = target center - source center,
+	//     (z - s)^(-1/2) = D^(-1/2) sum over a, k of G[k][a] t^a w^k,
+	//     G[k][a] = A[a][k] D^-(a + k),
+	// and the conjugate factor likewise, so
+	//     L[k][l] = 1/|D| sum over a, b of G[k][a] M[a][b] conj(G[l][b]).
+	auto const distance = complex(nodes[target].center_x - nodes[source].center_x, nodes[target].center_y - nodes[source].center_y);
+	auto const inverse_distance = 1.0 / std::abs(distance);
+
+	thread_local std::vector<complex> inverse_powers;
+	inverse_powers.resize(2 * width);
+	powers(1.0 / distance, inverse_powers.data(), 2 * width);
+
+	// Only terms of total degree a + k <= p are kept, so G is triangular.
+	auto* const factors = scratch.data();
+	auto* const half = scratch.data() + terms;
+	for (size_t k = 0; k < width; ++k) {
+		for (size_t a = 0; a < width; ++a)
+			factors[k * width + a] = a + k < width ? m2l_factors[a * width + k] * inverse_powers[a + k] : complex{};
+	}
+
+	for (size_t n = 0; n < sources; ++n) {
+		auto const* const from = multipole(source, n);
+		auto* const to = local(target, n);
+
+		// Row by row, so the inner loop runs along contiguous rows.
+		for (size_t k = 0; k < width; ++k) {
+			auto* const row = half + k * width;
+			std::fill(row, row + width, complex{});
+			for (size_t a = 0; a + k < width; ++a) {
+				auto const factor = factors[k * width + a];
+				for (size_t b = 0; b < width; ++b)
+					row[b] += times(factor, from[a * width + b]);
+			}
+		}
+
+		// M is Hermitian, as the masses and charges are real, so L is too
+		// and only its upper half needs working out.
+		for (size_t k = 0; k < width; ++k) {
+			for (size_t l = k; l < width; ++l) {
+				complex sum{};
+				for (size_t b = 0; b + l < width; ++b)
+					sum += times_conj(half[k * width + b], factors[l * width + b]);
+				sum *= inverse_distance;
+				to[k * width + l] += sum;
+				if (l != k)
+					to[l * width + k] += std::conj(sum);
+			}
+		}
+	}
+}
+
+void fast_multipole::local_to_local(size_t parent, size_t child, std::vector<complex>& scratch) {
+	// w about the parent is w about the child plus delta, so the parent's
+	// polynomial re-expands one index at a time like multipole_to_multipole,
+	// only summing downward.
+	auto* const shift = scratch.data();
+	auto* const half = scratch.data() + width;
+	auto const delta = complex(nodes[child].center_x - nodes[parent].center_x, nodes[child].center_y - nodes[parent].center_y);
+	powers(delta, shift, width);
+
+	for (size_t n = 0; n < sources; ++n) {
+		auto const* const from = local(parent, n);
+		auto* const to = local(child, n);
+
+		for (size_t k = 0; k < width; ++k) {
+			for (size_t l = 0; l < width; ++l) {
+				complex sum{};
+				for (auto j = l; j < width; ++j)
+					sum += choose[j * width + l] * times_conj(from[k * width + j], shift[j - l]);
+				half[k * width + l] = sum;
+			}
+		}
+		for (size_t k = 0; k < width; ++k) {
+			for (size_t l = 0; l < width; ++l) {
+				complex sum{};
+				for (auto j = k; j < width; ++j)
+					sum += choose[j * width + k] * times(shift[j - k], half[j * width + l]);
+				to[k * width + l] += sum;
+			}
+		}
+	}
+}
+
+mathematics::vector<float, 2> fast_multipole::force_on(size_t i, size_t* interactions) const noexcept {
+	mathematics::vector<float, 2> force;
+	if (i >= leaf_of.size() or nodes.empty())
+		return force;
+
+	auto const& box = nodes[leaf_of[i]];
+
+	// The particle's slot in tree order; its leaf holds few enough that a
+	// scan is cheaper than another index.
+	auto slot = box.begin;
+	while (order_of[slot] != i)
+		++slot;
+
+	auto const x = xs[slot];
+	auto const y = ys[slot];
+	auto const m = masses[slot];
+	auto const q = charges[slot];
+
+	// Far part: Fx + i Fy = 2 d(phi)/d(conj w)
+	//     = 2 sum over k, l >= 1 of l L[k][l] w^k conj(w)^(l - 1).
+	thread_local std::vector<complex> powers_of_w;
+	powers_of_w.resize(width);
+	powers(complex(x - box.center_x, y - box.center_y), powers_of_w.data(), width);
+
+	complex field[sources];
+	for (size_t n = 0; n < sources; ++n) {
+		auto const* const expansion = local(leaf_of[i], n);
+		for (size_t k = 0; k < width; ++k) {
+			complex sum{};
+			for (size_t l = 1; l < width; ++l)
+				sum += static_cast<double>(l) * times_conj(expansion[k * width + l], powers_of_w[l - 1]);
+			field[n] += times(powers_of_w[k], sum);
+		}
+	}
+
+	auto fx = static_cast<float>(2.0 * (g * m * field[0].real() + k * q * field[1].real()));
+	auto fy = static_cast<float>(2.0 * (g * m * field[0].imag() + k * q * field[1].imag()));
+
+	// Near part, particle by particle over the neighbouring leaves.
+	size_t terms_summed = far_boxes[leaf_of[i]].size();
+	for (auto const neighbour : near_boxes[leaf_of[i]]) {
+		auto const& other = nodes[neighbour];
+		for (auto s = other.begin; s < other.end; ++s) {
+			if (s == slot)
+				continue;
+			auto const dx = xs[s] - x;
+			auto const dy = ys[s] - y;
+			auto const dist_squared = dx * dx + dy * dy;
+			auto const dist = std::sqrt(dist_squared);
+			auto const scale = (g * m * masses[s] + k * q * charges[s]) / (dist_squared * dist);
+			fx += scale * dx;
+			fy += scale * dy;
+		}
+		terms_summed += other.end - other.begin;
+	}
+
+	if (interactions)
+		*interactions += terms_summed;
+
+	force[0] = fx;
+	force[1] = fy;
+	return force;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+#include "mathematics.hpp"
+#include "particle_arrays.hpp"
+#include "thread_pool.hpp"
+
+// Gravity and Coulomb forces by the fast multipole method, with expansions
+// of any order p. Unlike the monopoles of barnes_hut_tree, the expansions
+// keep the dipole and higher moments of a box, which is all that is left of
+// a box of electrons and protons once their charges cancel.
+//
+// The points are in the plane but the potential is the 1/r one of three
+// dimensions, so it is not harmonic in the plane and the usual complex
+// log expansions do not apply. It does factor as
+//     1 / |z - s| = (z - s)^(-1/2) conj(z - s)^(-1/2)
+// though, and each factor has a binomial series, so a box's multipole
+// expansion is a polynomial in t and conj(t), t = s - center, with
+// coefficients M[a][b] = sum of q t^a conj(t)^b for a, b <= p, and local
+// expansions the same in w = z - center. Every translation works on one
+// index at a time, so costs O(p^3).
+//
+// Boxes are paired off by a dual tree walk: two boxes whose radii add up to
+// less than the separation times the distance between their centers
+// interact through their expansions (M2L), leaf boxes that are too close
+// particle by particle. Each such far pair is within error_bound() of the
+// exact potential, relative to that of all the charge in the source box,
+// and a step is O(N) for a fixed order and separation.
+class fast_multipole {
+public:
+	struct settings {
+		unsigned order = 6;
+		float separation = 0.5f;
+	};
+
+	static constexpr unsigned max_order = 20;
+	static constexpr size_t leaf_capacity = 32;
+	static constexpr size_t max_depth = 24;
+
+	// Relative error bound of one far interaction's potential,
+	// 2 theta^(p + 1) / (1 - theta)^2, from the two truncated series. Forces
+	// come out of the same series, differentiated, so are about p times
+	// that.
+	static double error_bound(settings const& options) noexcept;
+
+	// Builds the tree, forms the multipole expansions upward and the local
+	// ones downward. Each level of either pass runs its boxes in parallel.
+	// The arrays must stay valid until the force_on calls are done.
+	void build(thread_pool& pool, particle_arrays const& particles, settings const& options);
+
+	// Gravity plus Coulomb force on the particle with dense index i at the
+	// time of build(), from its box's local expansion and the particles of
+	// the boxes next to it. If interactions is given, the number of
+	// particles and expansions summed is added to it.
+	mathematics::vector<float, 2> force_on(size_t i, size_t* interactions = nullptr) const noexcept;
+
+	size_t size() const noexcept {
+		return nodes.size();
+	}
+
+private:
+	using complex = std::complex<double>;
+
+	struct node {
+		double center_x;
+		double center_y;
+		double half_width;
+
+		// Largest distance from the center to a particle in the box.
+		double radius;
+
+		size_t begin;
+		size_t end;
+		size_t first_child;
+		size_t parent;
+	};
+
+	static constexpr size_t no_children = static_cast<size_t>(-1);
+
+	// Mass and charge expansions sit next to each other for every node.
+	static constexpr size_t sources = 2;
+
+	// Splits a node into four children, placed next to each other, and
+	// those in turn until they hold at most leaf_capacity particles.
+	void split_node(size_t index, size_t depth);
+
+	// The M2L and P2P lists, from the dual tree walk.
+	void pair_boxes(size_t a, size_t b);
+	void pair_within(size_t a);
+
+	complex* multipole(size_t n, size_t source) noexcept {
+		return multipoles.data() + (n * sources + source) * terms;
+	}
+
+	complex* local(size_t n, size_t source) noexcept {
+		return locals.data() + (n * sources + source) * terms;
+	}
+
+	complex const* local(size_t n, size_t source) const noexcept {
+		return locals.data() + (n * sources + source) * terms;
+	}
+
+	void particles_to_multipole(size_t n);
+	void multipole_to_multipole(size_t child, size_t parent);
+	void multipole_to_local(size_t source, size_t target, std::vector<complex>& scratch);
+	void local_to_local(size_t parent, size_t child, std::vector<complex>& scratch);
+
+	unsigned order = 0;
+	size_t width = 0;
+	size_t terms = 0;
+	double separation = 0.5;
+
+	// choose[n][k] and the M2L factors
+	//     A[a][k] = binom(-1/2, a) (-1)^a binom(-a - 1/2, k),
+	// (p + 1) x (p + 1) row-major.
+	std::vector<double> choose;
+	std::vector<double> m2l_factors;
+
+	std::vector<node> nodes;
+	std::vector<std::vector<size_t>> levels;
+	std::vector<std::vector<uint32_t>> far_boxes;
+	std::vector<std::vector<uint32_t>> near_boxes;
+
+	std::vector<complex> multipoles;
+	std::vector<complex> locals;
+
+	// Particles in tree order, and each particle's leaf.
+	std::vector<uint32_t> order_of;
+	std::vector<uint32_t> leaf_of;
+	std::vector<float> xs;
+	std::vector<float> ys;
+	std::vector<float> masses;
+	std::vector<float> charges;
+};
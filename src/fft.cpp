@@ -0,0 +1,120 @@
+#include "fft.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numbers>
+#include <utility>
+
+#include "index_range.hpp"
+
+fft_plan::fft_plan(size_t size)
+	: length(std::bit_ceil(std::max<size_t>(size, 1))),
+	reversed(length),
+	twiddles(length - 1) {
+	auto const bits = std::countr_zero(length);
+	for (size_t k = 0; k < length; ++k) {
+		size_t r = 0;
+		for (int b = 0; b < bits; ++b)
+			r |= ((k >> b) & 1) << (bits - 1 - b);
+		reversed[k] = static_cast<uint32_t>(r);
+	}
+
+	// The factors of each pass stored one after the other, as each pass
+	// walks its own in order; a pass of span 2h uses e^(-2 pi i k / 2h) for
+	// k < h and starts at h - 1.
+	for (size_t half = 1; half < length; half *= 2) {
+		for (size_t k = 0; k < half; ++k) {
+			auto const angle = -std::numbers::pi * static_cast<double>(k) / static_cast<double>(half);
+			twiddles[half - 1 + k] = complex(std::cos(angle), std::sin(angle));
+		}
+	}
+}
+
+void fft_plan::forward(complex* data) const noexcept {
+	transform(data, false);
+}
+
+void fft_plan::inverse(complex* data) const noexcept {
+	transform(data, true);
+}
+
+void fft_plan::transform(complex* data, bool inverse) const noexcept {
+	for (size_t k = 0; k < length; ++k) {
+		if (k < reversed[k])
+			std::swap(data[k], data[reversed[k]]);
+	}
+
+	// Butterflies of span 2, 4, ..., length, in real arithmetic as the
+	// complex product checks for infinities on every multiply.
+	auto* const values = reinterpret_cast<double*>(data);
+	auto const sign = inverse ? -1.0 : 1.0;
+	for (size_t half = 1; half < length; half *= 2) {
+		auto const* const factors = twiddles.data() + half - 1;
+		for (size_t first = 0; first < length; first += 2 * half) {
+			auto* const a = values + 2 * first;
+			auto* const b = values + 2 * (first + half);
+			for (size_t k = 0; k < half; ++k) {
+				auto const wr = factors[k].real();
+				auto const wi = sign * factors[k].imag();
+				auto const br = wr * b[2 * k] - wi * b[2 * k + 1];
+				auto const bi = wr * b[2 * k + 1] + wi * b[2 * k];
+				auto const ar = a[2 * k];
+				auto const ai = a[2 * k + 1];
+				a[2 * k] = ar + br;
+				a[2 * k + 1] = ai + bi;
+				b[2 * k] = ar - br;
+				b[2 * k + 1] = ai - bi;
+			}
+		}
+	}
+}
+
+namespace {
+
+	template<typename Transform>
+	void transform_rows(thread_pool& pool, size_t size, fft_plan::complex* grid, size_t rows, Transform const& f) {
+		pool.for_each(index_range(rows), [size, grid, &f](size_t r) {
+			f(grid + r * size);
+		}, 1);
+	}
+
+	// Columns are gathered into contiguous buffers first, a cache line's
+	// worth at a time, as walking one in place touches a new line with every
+	// element.
+	constexpr size_t columns_per_task = 64 / sizeof(fft_plan::complex);
+
+	template<typename Transform>
+	void transform_columns(thread_pool& pool, size_t size, fft_plan::complex* grid, Transform const& f) {
+		auto const block = std::min(columns_per_task, size);
+		pool.for_each(index_range(size / block), [size, grid, block, &f](size_t b) {
+			thread_local std::vector<fft_plan::complex> columns;
+			columns.resize(size * block);
+
+			auto const first = b * block;
+			for (size_t r = 0; r < size; ++r) {
+				for (size_t c = 0; c < block; ++c)
+					columns[c * size + r] = grid[r * size + first + c];
+			}
+			for (size_t c = 0; c < block; ++c)
+				f(columns.data() + c * size);
+			for (size_t r = 0; r < size; ++r) {
+				for (size_t c = 0; c < block; ++c)
+					grid[r * size + first + c] = columns[c * size + r];
+			}
+		}, 1);
+	}
+
+}
+
+void forward_2d(thread_pool& pool, fft_plan const& plan, fft_plan::complex* grid, size_t nonzero_rows) {
+	auto const forward = [&plan](fft_plan::complex* data) { plan.forward(data); };
+	transform_rows(pool, plan.size(), grid, std::min(nonzero_rows, plan.size()), forward);
+	transform_columns(pool, plan.size(), grid, forward);
+}
+
+void inverse_2d(thread_pool& pool, fft_plan const& plan, fft_plan::complex* grid, size_t wanted_rows) {
+	auto const inverse = [&plan](fft_plan::complex* data) { plan.inverse(data); };
+	transform_columns(pool, plan.size(), grid, inverse);
+	transform_rows(pool, plan.size(), grid, std::min(wanted_rows, plan.size()), inverse);
+}
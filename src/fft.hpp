@@ -0,0 +1,46 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+// In-place iterative radix-2 FFT of one power-of-two length, with the
+// twiddle factors and bit reversal permutation worked out once. In double,
+// as a transform's rounding error scales with the largest value in it.
+class fft_plan {
+public:
+	using complex = std::complex<double>;
+
+	fft_plan() = default;
+
+	// size is rounded up to a power of two.
+	explicit fft_plan(size_t size);
+
+	size_t size() const noexcept {
+		return length;
+	}
+
+	// data[j] becomes the sum over k of data[k] e^(-2 pi i j k / size).
+	void forward(complex* data) const noexcept;
+
+	// The same with e^(+2 pi i j k / size), unscaled, so forward then
+	// inverse multiplies by size.
+	void inverse(complex* data) const noexcept;
+
+private:
+	void transform(complex* data, bool inverse) const noexcept;
+
+	size_t length = 0;
+	std::vector<uint32_t> reversed;
+	std::vector<complex> twiddles;
+};
+
+// 2D transforms of a plan.size() squared row-major grid, one row or column
+// per task. The forward one skips the rows from nonzero_rows on, which must
+// be all zero, and the inverse one only finishes the rows below
+// wanted_rows; the rest are left half transformed.
+void forward_2d(thread_pool& pool, fft_plan const& plan, fft_plan::complex* grid, size_t nonzero_rows);
+void inverse_2d(thread_pool& pool, fft_plan const& plan, fft_plan::complex* grid, size_t wanted_rows);
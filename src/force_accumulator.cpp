@@ -0,0 +1,74 @@
+#include "force_accumulator.hpp"
+
+#include <functional>
+
+force_accumulator::lease::lease(force_accumulator* owner, size_t slot) noexcept
+	: owner(owner), slot(slot), buffer(owner->slots[slot].data()) {
+	owner->touched[slot].store(true, std::memory_order_relaxed);
+}
+
+force_accumulator::lease::lease(lease&& other) noexcept
+	: owner(other.owner), slot(other.slot), buffer(other.buffer) {
+	other.owner = nullptr;
+}
+
+force_accumulator::lease::~lease() {
+	if (owner != nullptr)
+		owner->busy[slot].store(false, std::memory_order_release);
+}
+
+force_accumulator::force_accumulator(size_t slot_count)
+	: particle_count(0),
+	slots(slot_count),
+	busy(std::make_unique<std::atomic<bool>[]>(slot_count)),
+	touched(std::make_unique<std::atomic<bool>[]>(slot_count)) {
+	for (size_t s = 0; s < slot_count; ++s) {
+		busy[s].store(false);
+		touched[s].store(false);
+	}
+}
+
+void force_accumulator::resize(size_t new_count) {
+	if (new_count <= particle_count)
+		return;
+
+	for (auto& slot : slots)
+		slot.resize(new_count);
+	particle_count = new_count;
+}
+
+force_accumulator::lease force_accumulator::acquire() noexcept {
+	// Start probing at a per-thread offset so workers usually get their
+	// own slot on the first try. There should be as many slots as threads
+	// leasing them, so a free one turns up quickly.
+	auto const start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+
+	for (;;) {
+		for (size_t probe = 0; probe < slots.size(); ++probe) {
+			auto const s = (start + probe) % slots.size();
+			if (!busy[s].load(std::memory_order_relaxed) and !busy[s].exchange(true, std::memory_order_acquire))
+				return lease(this, s);
+		}
+		std::this_thread::yield();
+	}
+}
+
+force_accumulator::force_t force_accumulator::take(size_t i) noexcept {
+	force_t total;
+
+	for (size_t s = 0; s < slots.size(); ++s) {
+		if (!touched[s].load(std::memory_order_relaxed))
+			continue;
+
+		auto& entry = slots[s][i];
+		total += entry;
+		entry = force_t();
+	}
+
+	return total;
+}
+
+void force_accumulator::end_pass() noexcept {
+	for (size_t s = 0; s < slots.size(); ++s)
+		touched[s].store(false, std::memory_order_relaxed);
+}
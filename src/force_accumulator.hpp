@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "mathematics.hpp"
+
+// A small pool of private force arrays for the pair pass. A task leases a
+// slot for the duration of a tile and adds into it with plain stores, and
+// the integration pass sums the slots back together per particle. The only
+// synchronization left is one exchange per lease instead of four atomic
+// read-modify-writes per pair.
+class force_accumulator {
+public:
+	using force_t = mathematics::vector<float, 2>;
+
+	class lease {
+	public:
+		lease(lease const&) = delete;
+		lease& operator=(lease const&) = delete;
+		lease(lease&& other) noexcept;
+		lease& operator=(lease&&) = delete;
+		~lease();
+
+		force_t& operator[](size_t i) noexcept {
+			return buffer[i];
+		}
+
+	private:
+		friend class force_accumulator;
+		lease(force_accumulator* owner, size_t slot) noexcept;
+
+		force_accumulator* owner;
+		size_t slot;
+		force_t* buffer;
+	};
+
+	// One slot per thread that leases them, such as thread_pool::size().
+	// With fewer, the extra threads wait for a slot to come free; each
+	// more costs a buffer and makes take() longer.
+	explicit force_accumulator(size_t slot_count = std::max(1u, std::thread::hardware_concurrency()));
+
+	// Buffers only grow, and new entries start zeroed.
+	void resize(size_t particle_count);
+
+	size_t size() const noexcept {
+		return particle_count;
+	}
+
+	lease acquire() noexcept;
+
+	// Sum of particle i's entries over every slot used since the last
+	// end_pass(). Those entries are zeroed again, so calling this once per
+	// particle leaves the pool ready for the next step. Safe to call for
+	// distinct i from different threads.
+	force_t take(size_t i) noexcept;
+
+	void end_pass() noexcept;
+
+private:
+	size_t particle_count;
+	std::vector<std::vector<force_t>> slots;
+	std::unique_ptr<std::atomic<bool>[]> busy;
+
+	// Set by lease holders. take() may run for some particles while tiles
+	// that do not involve them still lease slots, so this is atomic.
+	std::unique_ptr<std::atomic<bool>[]> touched;
+};
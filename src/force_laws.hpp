@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <type_traits>
+
+#include "mathematics.hpp"
+#include "particle_arrays.hpp"
+#include "species.hpp"
+#include "TypeList.hpp"
+
+// Everything a pairwise law might want to know about particles i and j,
+// computed once per pair no matter how many laws are registered.
+struct pair_geometry {
+	float dx;
+	float dy;
+	float dist_squared;
+	float inv_dist;
+	float inv_dist_cubed;
+
+	static pair_geometry between(particle_arrays const& p, size_t i, size_t j) noexcept {
+		auto const dx = p.x[j] - p.x[i];
+		auto const dy = p.y[j] - p.y[i];
+		auto const dist_squared = dx * dx + dy * dy;
+		auto const inv_dist = 1.f / std::sqrt(dist_squared);
+
+		return pair_geometry{ dx, dy, dist_squared, inv_dist, inv_dist * inv_dist * inv_dist };
+	}
+};
+
+// A force law is a type with
+//     static float scale(particle_arrays const&, size_t i, size_t j, pair_geometry const&)
+// returning s such that the force on i due to j is s * (dx, dy). Positive
+// is attractive. The force on j is the negation.
+//
+// A law that also has
+//     static constexpr float cutoff
+// is short ranged: it is zero beyond cutoff, so it can be summed over the
+// neighbours a neighbour_list finds instead of over every pair.
+template<typename Law>
+concept short_range_law = requires {
+	{ Law::cutoff } -> std::convertible_to<float>;
+};
+
+// And one with
+//     static constexpr bool needs_charge = true
+// is zero unless both particles are charged, so the passes leave it out
+// of pairs with a neutral particle (see particle_arrays::charged).
+template<typename Law>
+concept charge_law = requires {
+	requires Law::needs_charge;
+};
+
+// And one with
+//     static float coupling(species const& a, species const& b)
+// has a scale of coupling(a, b) / r^3 for particles of species a and b, so
+// its scales can be worked out once per pair of species (see
+// species_table).
+template<typename Law>
+concept inverse_cube_law = requires (species const& s) {
+	{ Law::coupling(s, s) } -> std::convertible_to<float>;
+};
+
+namespace force_laws {
+
+	struct gravity {
+		static float scale(particle_arrays const& p, size_t i, size_t j, pair_geometry const& geo) noexcept {
+			return g * p.mass[i] * p.mass[j] * geo.inv_dist_cubed;
+		}
+
+		static float coupling(species const& a, species const& b) noexcept {
+			return g * a.mass * b.mass;
+		}
+	};
+
+	struct coulomb {
+		static constexpr bool needs_charge = true;
+
+		static float scale(particle_arrays const& p, size_t i, size_t j, pair_geometry const& geo) noexcept {
+			return k * p.charge[i] * p.charge[j] * geo.inv_dist_cubed;
+		}
+
+		static float coupling(species const& a, species const& b) noexcept {
+			return k * a.charge * b.charge;
+		}
+	};
+
+	// Soft-core repulsion that dominates inside a few softening lengths and
+	// falls off like 1/r^3 outside, which keeps close encounters from
+	// blowing up. Not registered by default.
+	struct short_range_repulsion {
+		static constexpr float strength = 5000.f;
+		static constexpr float softening = 2.f;
+
+		static float scale(particle_arrays const&, size_t, size_t, pair_geometry const& geo) noexcept {
+			auto const softened = geo.dist_squared + softening * softening;
+			return -strength / (softened * softened);
+		}
+	};
+
+	// Coulomb screened by a surrounding cloud of mobile charge, the Yukawa
+	// potential k qi qj e^(-r / length) / r. Its force is Coulomb's times
+	// e^(-r / length) (1 + r / length), under 2% of it beyond six screening
+	// lengths, where it is cut off. Not registered by default.
+	struct screened_coulomb {
+		static constexpr float screening_length = 8.f;
+		static constexpr float cutoff = 6.f * screening_length;
+		static constexpr bool needs_charge = true;
+
+		static float scale(particle_arrays const& p, size_t i, size_t j, pair_geometry const& geo) noexcept {
+			if (geo.dist_squared >= cutoff * cutoff)
+				return 0.f;
+			auto const x = geo.dist_squared * geo.inv_dist / screening_length;
+			return k * p.charge[i] * p.charge[j] * std::exp(-x) * (1.f + x) * geo.inv_dist_cubed;
+		}
+	};
+
+	// Law, but zero beyond Cutoff, which makes any law short ranged.
+	template<typename Law, float Cutoff>
+	struct cut_off {
+		static constexpr float cutoff = Cutoff;
+		static constexpr bool needs_charge = charge_law<Law>;
+
+		static float scale(particle_arrays const& p, size_t i, size_t j, pair_geometry const& geo) noexcept {
+			return geo.dist_squared < cutoff * cutoff ? Law::scale(p, i, j, geo) : 0.f;
+		}
+	};
+}
+
+template<typename LawList>
+struct fused_interaction;
+
+// One kernel for any set of laws: the geometry is computed once and the
+// scales of every law are summed before touching the force vector, so a
+// new law adds arithmetic but never another pass over the pairs.
+template<typename ... Laws>
+struct fused_interaction<ListsViaTypes::TypeList<Laws...>> {
+	using LawList = ListsViaTypes::TypeList<Laws...>;
+
+	template<typename Law>
+	static constexpr bool includes() {
+		return LawList::template contains<Law>();
+	}
+
+	static mathematics::vector<float, 2> force(particle_arrays const& p, size_t i, size_t j) noexcept {
+		auto const geo = pair_geometry::between(p, i, j);
+		auto const s = (0.f + ... + Laws::scale(p, i, j, geo));
+
+		return mathematics::vector<float, 2>{ s * geo.dx, s * geo.dy };
+	}
+
+	// How far a neighbour_list has to look, when every law is short ranged.
+	static constexpr float cutoff() noexcept requires (short_range_law<Laws> and ...) {
+		return std::max({ Laws::cutoff... });
+	}
+
+	// The summed couplings of two species, when every law has one.
+	static float coupling(species const& a, species const& b) noexcept requires (inverse_cube_law<Laws> and ...) {
+		return (0.f + ... + Laws::coupling(a, b));
+	}
+};
+
+// The laws of a list that still act between a neutral particle and any
+// other.
+template<typename LawList>
+struct neutral_laws_of;
+
+template<>
+struct neutral_laws_of<ListsViaTypes::TypeList<>> {
+	using type = ListsViaTypes::TypeList<>;
+};
+
+template<typename Law, typename ... Rest>
+struct neutral_laws_of<ListsViaTypes::TypeList<Law, Rest...>> {
+	using rest = typename neutral_laws_of<ListsViaTypes::TypeList<Rest...>>::type;
+	using type = std::conditional_t<charge_law<Law>, rest, ListsViaTypes::ConcatenateLists<ListsViaTypes::TypeList<Law>, rest>>;
+};
+
+// The registry. Every law listed here is applied by the pair pass.
+using registered_force_laws = ListsViaTypes::TypeList<force_laws::gravity, force_laws::coulomb>;
+
+using pair_force = fused_interaction<registered_force_laws>;
+
+// For pairs with at least one neutral particle.
+using neutral_pair_force = fused_interaction<typename neutral_laws_of<registered_force_laws>::type>;
+
+// The short-range registry, which the short-range solver applies in place
+// of the one above, summed over each particle's neighbours within the
+// largest cutoff. Every law listed here must be short ranged.
+using registered_short_range_laws = ListsViaTypes::TypeList<force_laws::screened_coulomb>;
+
+using short_range_pair_force = fused_interaction<registered_short_range_laws>;
+
+// pair_force with the couplings looked up by species (see
+// particle_arrays::species), which reads a byte per particle in place of a
+// mass and a charge and leaves one multiply per pair.
+struct species_pair_force {
+	static mathematics::vector<float, 2> force(particle_arrays const& p, size_t i, size_t j) noexcept {
+		auto const geo = pair_geometry::between(p, i, j);
+		auto const s = p.couplings[p.species[i] * p.species_count + p.species[j]] * geo.inv_dist_cubed;
+
+		return mathematics::vector<float, 2>{ s * geo.dx, s * geo.dy };
+	}
+};
@@ -0,0 +1,302 @@
+// headless.cpp : Runs the simulation without a window, as fast as it will go.
+//
+// usage: 2d_physics_headless [steps] [direct|vectorized|barnes-hut|mesh|fmm|short-range] [num_dots] [profile.csv|profile.json]
+//                            [--load checkpoint] [--save checkpoint] [--checkpoint-every steps]
+//                            [--trajectory path] [--trajectory-every steps] [--position-bits bits]
+//                            [--deterministic] [--seed seed] [--timestep-levels levels]
+//                            [--inner-steps steps] [--near-cutoff distance] [--skin distance]
+//                            [--integrator leapfrog|verlet|forest-ruth] [--timestep dt]
+//                            [--threads count] [--pin] [--mesh cells] [--assignment cic|tsc]
+//                            [--order p] [--separation theta]
+//
+// With a profile path every step's phase timings are written there and a
+// summary is printed at the end. --load starts from a checkpoint instead of
+// spawning num_dots particles; --save writes one at the end and, with
+// --checkpoint-every, also every that many steps along the way.
+// --trajectory records positions and velocities every --trajectory-every
+// steps, compressed, for offline analysis. --deterministic together with
+// --seed (or --load) makes two runs bitwise identical on any thread count.
+// --timestep-levels lets fast particles take up to 2^levels substeps per
+// step while the slow ones take one. --inner-steps splits forces into a near
+// part within --near-cutoff, stepped that many times per dt, and a far part
+// evaluated once per dt; the near part's neighbour lists reach --skin past
+// the cutoff and are reused until a particle has moved half that, as do
+// the short-range solver's, which only applies the short-range laws.
+// --integrator picks the stepping scheme and --timestep overrides dt;
+// forest-ruth is fourth order and tolerates a longer timestep for the same
+// energy error. --threads sets the size of the stepping thread pool, one
+// per hardware thread by default, and --pin pins its workers to cores.
+// --mesh and --assignment set the size of the mesh the mesh solver spreads
+// mass and charge over, and how it spreads them.
+// --order and --separation set the expansion order of the fmm solver and
+// how far apart two boxes must be to interact through their expansions.
+
+#include "checkpoint.hpp"
+#include "simulation.hpp"
+#include "trajectory.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+
+	bool parse_solver(std::string_view name, force_solver& solver) {
+		if (name == "direct")
+			solver = force_solver::direct_sum;
+		else if (name == "vectorized")
+			solver = force_solver::vectorized_direct_sum;
+		else if (name == "barnes-hut")
+			solver = force_solver::barnes_hut;
+		else if (name == "mesh")
+			solver = force_solver::particle_mesh;
+		else if (name == "fmm")
+			solver = force_solver::fast_multipole;
+		else if (name == "short-range")
+			solver = force_solver::short_range;
+		else
+			return false;
+		return true;
+	}
+
+	bool parse_assignment(std::string_view name, mesh_assignment& assignment) {
+		if (name == "cic")
+			assignment = mesh_assignment::cloud_in_cell;
+		else if (name == "tsc")
+			assignment = mesh_assignment::triangular_shaped_cloud;
+		else
+			return false;
+		return true;
+	}
+
+	bool parse_integrator(std::string_view name, integrator& which) {
+		if (name == "leapfrog")
+			which = integrator::leapfrog;
+		else if (name == "verlet")
+			which = integrator::velocity_verlet;
+		else if (name == "forest-ruth")
+			which = integrator::forest_ruth;
+		else
+			return false;
+		return true;
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	size_t steps = 100;
+	size_t num_dots = simulation::default_num_dots;
+	force_solver solver = force_solver::direct_sum;
+	std::string load_path;
+	std::string save_path;
+	size_t checkpoint_every = 0;
+	std::string trajectory_path;
+	trajectory_writer::options trajectory_options;
+	bool deterministic = false;
+	std::optional<uint32_t> seed;
+	unsigned timestep_levels = 0;
+	unsigned inner_steps = 1;
+	float near_cutoff = simulation::default_near_cutoff;
+	float near_skin = simulation::default_near_skin;
+	integrator integration = integrator::leapfrog;
+	float timestep = dt;
+	thread_pool::options threads;
+	particle_mesh::settings mesh;
+	fast_multipole::settings multipole;
+
+	std::vector<std::string_view> positional;
+	for (int a = 1; a < argc; ++a) {
+		std::string_view const arg(argv[a]);
+		if (!arg.starts_with("--")) {
+			positional.push_back(arg);
+			continue;
+		}
+
+		if (arg == "--deterministic") {
+			deterministic = true;
+			continue;
+		}
+
+		if (arg == "--pin") {
+			threads.pin = true;
+			continue;
+		}
+
+		if (a + 1 == argc) {
+			fmt::print(stderr, "{} needs a value\n", arg);
+			return EXIT_FAILURE;
+		}
+
+		if (arg == "--load")
+			load_path = argv[++a];
+		else if (arg == "--save")
+			save_path = argv[++a];
+		else if (arg == "--checkpoint-every")
+			checkpoint_every = std::strtoull(argv[++a], nullptr, 10);
+		else if (arg == "--trajectory")
+			trajectory_path = argv[++a];
+		else if (arg == "--trajectory-every")
+			trajectory_options.every = std::strtoull(argv[++a], nullptr, 10);
+		else if (arg == "--position-bits")
+			trajectory_options.position_bits = static_cast<uint32_t>(std::strtoul(argv[++a], nullptr, 10));
+		else if (arg == "--timestep-levels")
+			timestep_levels = static_cast<unsigned>(std::strtoul(argv[++a], nullptr, 10));
+		else if (arg == "--inner-steps")
+			inner_steps = static_cast<unsigned>(std::strtoul(argv[++a], nullptr, 10));
+		else if (arg == "--near-cutoff")
+			near_cutoff = std::strtof(argv[++a], nullptr);
+		else if (arg == "--skin")
+			near_skin = std::strtof(argv[++a], nullptr);
+		else if (arg == "--integrator") {
+			std::string_view const name(argv[++a]);
+			if (!parse_integrator(name, integration)) {
+				fmt::print(stderr, "Unknown integrator {}, expected leapfrog, verlet or forest-ruth\n", name);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg == "--timestep")
+			timestep = std::strtof(argv[++a], nullptr);
+		else if (arg == "--threads")
+			threads.threads = static_cast<unsigned>(std::strtoul(argv[++a], nullptr, 10));
+		else if (arg == "--mesh")
+			mesh.cells = std::strtoull(argv[++a], nullptr, 10);
+		else if (arg == "--assignment") {
+			std::string_view const name(argv[++a]);
+			if (!parse_assignment(name, mesh.assignment)) {
+				fmt::print(stderr, "Unknown assignment {}, expected cic or tsc\n", name);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg == "--order")
+			multipole.order = static_cast<unsigned>(std::strtoul(argv[++a], nullptr, 10));
+		else if (arg == "--separation")
+			multipole.separation = std::strtof(argv[++a], nullptr);
+		else if (arg == "--seed")
+			seed = static_cast<uint32_t>(std::strtoul(argv[++a], nullptr, 10));
+		else {
+			fmt::print(stderr, "Unknown option {}\n", arg);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (positional.size() > 0)
+		steps = std::strtoull(positional[0].data(), nullptr, 10);
+	if (positional.size() > 1 and !parse_solver(positional[1], solver)) {
+		fmt::print(stderr, "Unknown solver {}, expected direct, vectorized, barnes-hut, mesh, fmm or short-range\n", positional[1]);
+		return EXIT_FAILURE;
+	}
+	if (positional.size() > 2)
+		num_dots = std::strtoull(positional[2].data(), nullptr, 10);
+
+	simulation sim;
+	sim.set_threads(threads);
+	sim.set_force_solver(solver);
+	sim.set_deterministic(deterministic);
+	sim.set_timestep_levels(timestep_levels);
+	sim.set_inner_steps(inner_steps);
+	sim.set_near_field(near_cutoff / 2, near_cutoff);
+	sim.set_near_skin(near_skin);
+	sim.set_integrator(integration);
+	sim.set_timestep(timestep);
+	sim.set_mesh(mesh);
+	sim.set_multipole(multipole);
+	if (seed)
+		sim.seed(*seed);
+
+	if (load_path.empty()) {
+		sim.spawn_particles(num_dots);
+	}
+	else {
+		mapped_checkpoint checkpoint;
+		if (!checkpoint.open(load_path)) {
+			fmt::print(stderr, "Could not load checkpoint: {}\n", checkpoint.error());
+			return EXIT_FAILURE;
+		}
+		restore_checkpoint(sim, checkpoint);
+		fmt::print("Loaded step {} from {}\n", sim.get_step_count(), load_path);
+	}
+
+	if (positional.size() > 3) {
+		std::string const path(positional[3]);
+		auto const format = path.ends_with(".json") ? step_profiler::export_format::json : step_profiler::export_format::csv;
+
+		if (!sim.get_profiler().export_to(path, format)) {
+			fmt::print(stderr, "Could not open {} for writing\n", path);
+			return EXIT_FAILURE;
+		}
+		sim.get_profiler().set_enabled(true);
+	}
+
+	checkpoint_writer writer;
+
+	trajectory_writer trajectory;
+	if (!trajectory_path.empty()) {
+		if (!trajectory.open(trajectory_path, trajectory_options))
+			return EXIT_FAILURE;
+		trajectory.record(sim);
+	}
+
+	fmt::print("Vectorized direct sum uses {}\n", simd_level_name(best_simd_level()));
+	fmt::print("Stepping {} particles {} times by {} with the {} force solver and {}{}, on {} threads\n", sim.size(), steps, timestep,
+		force_solver_name(solver), integrator_name(integration), deterministic ? ", deterministically" : "", sim.get_threads());
+
+	using clock = std::chrono::steady_clock;
+	using seconds = std::chrono::duration<double>;
+
+	double total = 0.0;
+	double fastest = 0.0;
+	double slowest = 0.0;
+
+	for (size_t s = 0; s < steps; ++s) {
+		auto const tick = clock::now();
+		sim.step();
+		auto const took = seconds(clock::now() - tick).count();
+
+		total += took;
+		fastest = s == 0 ? took : std::min(fastest, took);
+		slowest = std::max(slowest, took);
+
+		trajectory.record(sim);
+
+		if (!save_path.empty() and checkpoint_every > 0 and (s + 1) % checkpoint_every == 0)
+			writer.save_async(sim, save_path);
+	}
+
+	if (!save_path.empty()) {
+		writer.save_async(sim, save_path);
+		writer.wait();
+	}
+
+	if (trajectory.is_open()) {
+		auto const frames = trajectory.frames_recorded();
+		if (!trajectory.close())
+			return EXIT_FAILURE;
+		fmt::print("Recorded {} frames to {}\n", frames, trajectory_path);
+	}
+
+	if (steps == 0)
+		return EXIT_SUCCESS;
+
+	fmt::print("total {:.3f} s, per step mean {:.3f} ms, min {:.3f} ms, max {:.3f} ms\n",
+		total, 1e3 * total / steps, 1e3 * fastest, 1e3 * slowest);
+	fmt::print("{:.1f} steps/s, {:.4g} particle-steps/s\n",
+		steps / total, static_cast<double>(steps) * sim.size() / total);
+
+	if (timestep_levels > 0) {
+		auto const population = sim.timestep_population();
+		for (size_t level = 0; level < population.size(); ++level)
+			fmt::print("level {} (dt/{}): {} particles\n", level, 1u << level, population[level]);
+	}
+
+	if (sim.get_profiler().enabled())
+		sim.get_profiler().print_summary();
+
+	return EXIT_SUCCESS;
+}
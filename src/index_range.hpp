@@ -0,0 +1,69 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <iterator>
+
+// [first, last) as a random-access range of indices, so the parallel
+// algorithms can run over dense columns by index without materializing one.
+class index_range {
+public:
+	class iterator {
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = size_t;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = size_t;
+
+		iterator() noexcept : index(0) { }
+		explicit iterator(size_t index) noexcept : index(index) { }
+
+		size_t operator*() const noexcept { return index; }
+		size_t operator[](difference_type n) const noexcept { return index + n; }
+
+		iterator& operator++() noexcept { ++index; return *this; }
+		iterator operator++(int) noexcept { auto copy = *this; ++index; return copy; }
+		iterator& operator--() noexcept { --index; return *this; }
+		iterator operator--(int) noexcept { auto copy = *this; --index; return copy; }
+
+		iterator& operator+=(difference_type n) noexcept { index += n; return *this; }
+		iterator& operator-=(difference_type n) noexcept { index -= n; return *this; }
+		iterator operator+(difference_type n) const noexcept { return iterator(index + n); }
+		iterator operator-(difference_type n) const noexcept { return iterator(index - n); }
+		friend iterator operator+(difference_type n, iterator it) noexcept { return it + n; }
+
+		difference_type operator-(iterator const& other) const noexcept {
+			return static_cast<difference_type>(index) - static_cast<difference_type>(other.index);
+		}
+
+		bool operator==(iterator const& other) const noexcept { return index == other.index; }
+		auto operator<=>(iterator const& other) const noexcept { return index <=> other.index; }
+
+	private:
+		size_t index;
+	};
+
+	explicit index_range(size_t last) noexcept : first(0), last(last) { }
+	index_range(size_t first, size_t last) noexcept : first(first), last(last < first ? first : last) { }
+
+	iterator begin() const noexcept {
+		return iterator(first);
+	}
+
+	iterator end() const noexcept {
+		return iterator(last);
+	}
+
+	size_t size() const noexcept {
+		return last - first;
+	}
+
+	bool empty() const noexcept {
+		return first == last;
+	}
+
+private:
+	size_t first;
+	size_t last;
+};
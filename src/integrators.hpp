@@ -0,0 +1,111 @@
+#pragma once
+
+#include <utility>
+
+// Integrators are policies: a type with
+//     static constexpr char const* name
+//     static constexpr unsigned force_evaluations
+//     template<typename Ops> static void step(Ops& ops, float h)
+// where step advances by h using only
+//     ops.kick(c)               v += c * a
+//     ops.drift(c)              x += c * v
+//     ops.drift_accelerated(c)  x += c * v + c * c / 2 * a
+//     ops.update_forces()       a = F(x) / m
+//     ops.update_forces_and_kick(c)
+//                               update_forces() then kick(c), but a
+//                               particle may be kicked as soon as its own
+//                               force is known
+// Every step may assume a matches x on entry and leaves it matching, so
+// the last force evaluation of one step is the first of the next. Being
+// templates, the stepping code is compiled separately for every policy with
+// no calls through pointers in between.
+enum class integrator {
+	leapfrog,
+	velocity_verlet,
+	forest_ruth
+};
+
+namespace integrators {
+
+	// Kick-drift-kick leapfrog: second order, symplectic, one force
+	// evaluation per step.
+	struct leapfrog {
+		static constexpr char const* name = "kick-drift-kick leapfrog";
+		static constexpr unsigned force_evaluations = 1;
+
+		template<typename Ops>
+		static void step(Ops& ops, float h) {
+			ops.kick(0.5f * h);
+			ops.drift(h);
+			ops.update_forces_and_kick(0.5f * h);
+		}
+	};
+
+	// The same trajectory as leapfrog in exact arithmetic, written the
+	// textbook way: positions from the old velocity and acceleration, then
+	// the velocity from the mean of the old and new accelerations.
+	struct velocity_verlet {
+		static constexpr char const* name = "velocity Verlet";
+		static constexpr unsigned force_evaluations = 1;
+
+		template<typename Ops>
+		static void step(Ops& ops, float h) {
+			ops.drift_accelerated(h);
+			ops.kick(0.5f * h);
+			ops.update_forces_and_kick(0.5f * h);
+		}
+	};
+
+	// Forest-Ruth, which is Yoshida's fourth order triple jump of leapfrog
+	// steps of theta h, (1 - 2 theta) h and theta h with the kicks between
+	// them merged. Three force evaluations per step, but the error falls
+	// with h^4, so it can take much longer steps for the same drift.
+	struct forest_ruth {
+		static constexpr char const* name = "Forest-Ruth";
+		static constexpr unsigned force_evaluations = 3;
+
+		// 1 / (2 - 2^(1/3))
+		static constexpr float theta = 1.35120719195965763f;
+
+		template<typename Ops>
+		static void step(Ops& ops, float h) {
+			ops.kick(0.5f * theta * h);
+			ops.drift(theta * h);
+			ops.update_forces_and_kick(0.5f * (1.f - theta) * h);
+			ops.drift((1.f - 2.f * theta) * h);
+			ops.update_forces_and_kick(0.5f * (1.f - theta) * h);
+			ops.drift(theta * h);
+			ops.update_forces_and_kick(0.5f * theta * h);
+		}
+	};
+
+	// Bundles the operations a policy's step() needs.
+	template<typename Kick, typename Drift, typename DriftAccelerated, typename UpdateForces, typename UpdateForcesAndKick>
+	struct ops {
+		Kick kick;
+		Drift drift;
+		DriftAccelerated drift_accelerated;
+		UpdateForces update_forces;
+		UpdateForcesAndKick update_forces_and_kick;
+	};
+
+	template<typename Kick, typename Drift, typename DriftAccelerated, typename UpdateForces, typename UpdateForcesAndKick>
+	ops(Kick, Drift, DriftAccelerated, UpdateForces, UpdateForcesAndKick) -> ops<Kick, Drift, DriftAccelerated, UpdateForces, UpdateForcesAndKick>;
+
+	// Calls f.template operator()<Policy>() for the policy behind which.
+	template<typename Function>
+	decltype(auto) dispatch(integrator which, Function&& f) {
+		switch (which) {
+		case integrator::velocity_verlet:
+			return std::forward<Function>(f).template operator()<velocity_verlet>();
+		case integrator::forest_ruth:
+			return std::forward<Function>(f).template operator()<forest_ruth>();
+		default:
+			return std::forward<Function>(f).template operator()<leapfrog>();
+		}
+	}
+}
+
+inline char const* integrator_name(integrator which) noexcept {
+	return integrators::dispatch(which, []<typename Integrator>() { return Integrator::name; });
+}
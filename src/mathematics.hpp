@@ -1,4 +1,8 @@
+#pragma once
+
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <concepts>
 #include <initializer_list>
 #include <memory>
@@ -67,7 +71,7 @@ namespace mathematics {
 			array& operator=(array&&) = default;
 
 			array(std::initializer_list<Scalar> list) {
-				for (auto i = 0; i < std::min(Dimension, list.size()); ++i)
+				for (size_t i = 0; i < std::min(Dimension, list.size()); ++i)
 					data[i] = std::data(list)[i];
 			}
 
@@ -275,7 +279,7 @@ namespace mathematics {
 	Scalar hypotenuse(vector<Scalar, Dimension> const &argument) noexcept {
 		Scalar hypot = 0;
 
-		for (auto i = 0; i < Dimension; ++i)
+		for (size_t i = 0; i < Dimension; ++i)
 			hypot += argument[i] * argument[i];
 
 		return std::sqrt(hypot);
@@ -342,9 +346,9 @@ namespace mathematics {
 	template<concepts::RingLike Scalar, size_t i, size_t j,size_t k>
 	matrix<Scalar, i, k> operator*(matrix<Scalar,i,j> const &multiplicand, matrix<Scalar, j, k> const &multiplier) {
 		matrix<Scalar, i, k> product;
-		for (auto x = 0; x < i; ++x)
-			for (auto y = 0; y < k; ++y)
-				for (auto z = 0; z < j; ++z)
+		for (size_t x = 0; x < i; ++x)
+			for (size_t y = 0; y < k; ++y)
+				for (size_t z = 0; z < j; ++z)
 					product(x, y) += multiplicand(x, z) * multiplier(z, y);
 		return product;
 	}
@@ -0,0 +1,35 @@
+#include "near_field.hpp"
+
+#include <atomic>
+#include <cmath>
+
+#include "force_laws.hpp"
+#include "index_range.hpp"
+
+void near_field::accelerations(thread_pool& pool, particle_arrays const& p, smooth_switch const& split, float skin, std::vector<float>& ax, std::vector<float>& ay) {
+	auto const n = p.size;
+	ax.resize(n);
+	ay.resize(n);
+
+	neighbours.update(pool, p, { split.cutoff, skin });
+
+	std::atomic<size_t> visited = 0;
+	index_range const everyone(n);
+
+	pool.for_each(everyone, [this, &p, &split, &ax, &ay, &visited](size_t i) {
+		mathematics::vector<float, 2> total;
+		size_t found = 0;
+		neighbours.for_each_neighbour(i, [&](size_t j) {
+			++found;
+			auto const dx = p.x[j] - p.x[i];
+			auto const dy = p.y[j] - p.y[i];
+			total += split(std::sqrt(dx * dx + dy * dy)) * pair_force::force(p, i, j);
+		});
+
+		ax[i] = total[0] / p.mass[i];
+		ay[i] = total[1] / p.mass[i];
+		visited.fetch_add(found, std::memory_order_relaxed);
+	});
+
+	pairs = visited.load();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+#include "neighbour_list.hpp"
+#include "particle_arrays.hpp"
+#include "thread_pool.hpp"
+
+// Splits a pair force into a near part S(r) F(r) and a far part
+// (1 - S(r)) F(r). S is 1 inside start, 0 beyond cutoff and a quintic
+// smoothstep in between, so both parts are smooth in r. Either part is still
+// a central force of r alone and so derives from a potential, which is what
+// keeps an integrator that treats them separately symplectic.
+struct smooth_switch {
+	float start;
+	float cutoff;
+
+	float operator()(float r) const noexcept {
+		if (r <= start)
+			return 1.f;
+		if (r >= cutoff)
+			return 0.f;
+		auto const x = (r - start) / (cutoff - start);
+		return 1.f - x * x * x * (10.f + x * (-15.f + 6.f * x));
+	}
+};
+
+// The near part of the registered force laws, from the particles within
+// the cutoff of each particle as found by a neighbour_list. With a skin the
+// inner steps of a split step mostly reuse its Verlet lists.
+class near_field {
+public:
+	// Sets ax and ay (sized p.size) to the near-field acceleration of every
+	// particle. Each particle sums its own neighbours in list order, so the
+	// result does not depend on the thread count.
+	void accelerations(thread_pool& pool, particle_arrays const& p, smooth_switch const& split, float skin, std::vector<float>& ax, std::vector<float>& ay);
+
+	// For when particles were added or removed.
+	void invalidate() noexcept {
+		neighbours.invalidate();
+	}
+
+	size_t rebuilds() const noexcept {
+		return neighbours.rebuilds();
+	}
+
+	// Neighbour pairs, counting each one from both sides, in the last call.
+	size_t pairs_visited() const noexcept {
+		return pairs;
+	}
+
+private:
+	neighbour_list neighbours;
+	size_t pairs = 0;
+};
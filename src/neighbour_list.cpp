@@ -0,0 +1,141 @@
+#include "neighbour_list.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "index_range.hpp"
+
+bool neighbour_list::update(thread_pool& pool, particle_arrays const& p, settings const& options) {
+	auto const n = p.size;
+	auto const same_reach = options.cutoff == cutoff and options.skin == skin;
+	particles = p;
+	cutoff = std::max(0.f, options.cutoff);
+	skin = std::max(0.f, options.skin);
+
+	if (skin > 0.f and same_reach and listed_count == n and n != 0) {
+		// Moving half the skin each is the most two particles can close in
+		// by without one of them crossing into the other's cutoff unlisted.
+		float moved_squared = 0.f;
+		for (size_t i = 0; i < n; ++i) {
+			auto const dx = p.x[i] - listed_x[i];
+			auto const dy = p.y[i] - listed_y[i];
+			moved_squared = std::max(moved_squared, dx * dx + dy * dy);
+		}
+		if (moved_squared <= 0.25f * skin * skin)
+			return false;
+	}
+
+	bin(p);
+	if (skin > 0.f)
+		list(pool);
+	else
+		listed_count = 0;
+
+	++rebuild_count;
+	return true;
+}
+
+uint32_t neighbour_list::bucket_of(int64_t column, int64_t row) const noexcept {
+	auto h = static_cast<uint64_t>(column) * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(row) * 0xC2B2AE3D27D4EB4Full;
+	h ^= h >> 29;
+	return static_cast<uint32_t>(h & (bucket_start.size() - 2));
+}
+
+size_t neighbour_list::buckets_around(float x, float y, uint32_t* buckets) const noexcept {
+	auto const column = static_cast<int64_t>(std::floor(x * inverse_cell_size));
+	auto const row = static_cast<int64_t>(std::floor(y * inverse_cell_size));
+
+	size_t count = 0;
+	for (int64_t r = row - 1; r <= row + 1; ++r) {
+		for (int64_t c = column - 1; c <= column + 1; ++c) {
+			auto const bucket = bucket_of(c, r);
+			if (std::find(buckets, buckets + count, bucket) == buckets + count)
+				buckets[count++] = bucket;
+		}
+	}
+	return count;
+}
+
+void neighbour_list::bin(particle_arrays const& p) {
+	auto const n = p.size;
+
+	// A cell of zero width would put every particle in a cell of its own.
+	cell_size = std::max(cutoff + skin, 1e-3f);
+	inverse_cell_size = 1.f / cell_size;
+
+	// A power of two, so bucket_of can mask, plus the end of the last
+	// bucket.
+	auto const buckets = std::bit_ceil(std::max<size_t>(2 * n, 16));
+	bucket_start.assign(buckets + 1, 0);
+	bucket_of_particle.resize(n);
+
+	for (size_t i = 0; i < n; ++i) {
+		auto const column = static_cast<int64_t>(std::floor(p.x[i] * inverse_cell_size));
+		auto const row = static_cast<int64_t>(std::floor(p.y[i] * inverse_cell_size));
+		auto const b = bucket_of(column, row);
+		bucket_of_particle[i] = b;
+		++bucket_start[b + 1];
+	}
+
+	for (size_t b = 0; b < buckets; ++b)
+		bucket_start[b + 1] += bucket_start[b];
+
+	sorted_index.resize(n);
+	sorted_x.resize(n);
+	sorted_y.resize(n);
+
+	// Scatter, advancing each bucket's start as its slots fill, then shift
+	// the starts back down by one bucket.
+	for (size_t i = 0; i < n; ++i) {
+		auto const s = bucket_start[bucket_of_particle[i]]++;
+		sorted_index[s] = static_cast<uint32_t>(i);
+		sorted_x[s] = p.x[i];
+		sorted_y[s] = p.y[i];
+	}
+	for (auto b = buckets; b > 0; --b)
+		bucket_start[b] = bucket_start[b - 1];
+	bucket_start[0] = 0;
+}
+
+void neighbour_list::list(thread_pool& pool) {
+	auto const n = particles.size;
+	auto const reach = cutoff + skin;
+	auto const reach_squared = reach * reach;
+	index_range const everyone(n);
+
+	// Counted first and filled second, each particle on its own, so the
+	// lists can be written in place in parallel.
+	list_start.assign(n + 1, 0);
+	pool.for_each(everyone, [this, reach_squared](size_t i) {
+		auto const x = particles.x[i];
+		auto const y = particles.y[i];
+		uint32_t count = 0;
+		for_each_binned(x, y, [&](uint32_t s) {
+			auto const dx = sorted_x[s] - x;
+			auto const dy = sorted_y[s] - y;
+			count += sorted_index[s] != i and dx * dx + dy * dy < reach_squared;
+		});
+		list_start[i + 1] = count;
+	});
+
+	for (size_t i = 0; i < n; ++i)
+		list_start[i + 1] += list_start[i];
+	listed.resize(list_start[n]);
+
+	pool.for_each(everyone, [this, reach_squared](size_t i) {
+		auto const x = particles.x[i];
+		auto const y = particles.y[i];
+		auto next = list_start[i];
+		for_each_binned(x, y, [&](uint32_t s) {
+			auto const dx = sorted_x[s] - x;
+			auto const dy = sorted_y[s] - y;
+			if (sorted_index[s] != i and dx * dx + dy * dy < reach_squared)
+				listed[next++] = sorted_index[s];
+		});
+	});
+
+	listed_x.assign(particles.x, particles.x + n);
+	listed_y.assign(particles.y, particles.y + n);
+	listed_count = n;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "particle_arrays.hpp"
+#include "thread_pool.hpp"
+
+// Finds the particles within a cutoff of each other. Particles are binned
+// into square cells at least as wide as the cutoff plus the skin, so all of
+// a particle's neighbours are in its own cell or the 8 around it. Cells are
+// hashed into a table of about twice as many buckets as particles rather
+// than laid out over the bounding box, so the few particles flung far out
+// of the rest do not stretch the cells until everyone is a neighbour.
+//
+// With a skin, each particle's neighbours out to the cutoff plus the skin
+// are listed when the particles are binned (a Verlet list), and later
+// updates keep the lists until some particle has moved more than half the
+// skin since. Until then no pair can have come within the cutoff without
+// being listed, so the lists stand in for binning again. Without a skin the
+// particles are binned on every update and the cells walked directly.
+//
+// Every buffer keeps its capacity, so once the particle count settles an
+// update allocates nothing.
+class neighbour_list {
+public:
+	struct settings {
+		float cutoff = 16.f;
+		float skin = 0.f;
+	};
+
+	// Brings the neighbours up to date with the positions in p, binning
+	// again if the lists cannot be kept. Returns whether it did. The arrays
+	// must stay valid until the for_each_neighbour calls are done.
+	bool update(thread_pool& pool, particle_arrays const& p, settings const& options);
+
+	// Forgets the lists, so the next update bins the particles again. For
+	// when particles were added or removed, which moves dense indices.
+	void invalidate() noexcept {
+		listed_count = 0;
+	}
+
+	// Calls f(j) for every other particle j within the cutoff of i, in an
+	// order that only depends on the positions at the last binning.
+	template<typename Neighbour>
+	void for_each_neighbour(size_t i, Neighbour&& f) const;
+
+	// Times the particles have been binned so far.
+	size_t rebuilds() const noexcept {
+		return rebuild_count;
+	}
+
+private:
+	void bin(particle_arrays const& p);
+	void list(thread_pool& pool);
+
+	// The distinct buckets of the 3 x 3 cells around a position. Neighbouring
+	// cells can share a bucket, which would otherwise be walked twice.
+	size_t buckets_around(float x, float y, uint32_t* buckets) const noexcept;
+
+	uint32_t bucket_of(int64_t column, int64_t row) const noexcept;
+
+	template<typename Candidate>
+	void for_each_binned(float x, float y, Candidate&& f) const;
+
+	particle_arrays particles{};
+	float cutoff = 0.f;
+	float skin = 0.f;
+	float cell_size = 1.f;
+	float inverse_cell_size = 1.f;
+	size_t rebuild_count = 0;
+
+	// bucket_start[b] .. bucket_start[b + 1] are the sorted slots of bucket
+	// b, with the particles' positions as they were binned.
+	std::vector<uint32_t> bucket_start;
+	std::vector<uint32_t> bucket_of_particle;
+	std::vector<uint32_t> sorted_index;
+	std::vector<float> sorted_x;
+	std::vector<float> sorted_y;
+
+	// The Verlet lists, list_start[i] .. list_start[i + 1] in listed, and
+	// the positions they were made from. listed_count is the particle count
+	// they are for, 0 when there are none.
+	size_t listed_count = 0;
+	std::vector<uint32_t> list_start;
+	std::vector<uint32_t> listed;
+	std::vector<float> listed_x;
+	std::vector<float> listed_y;
+};
+
+template<typename Candidate>
+void neighbour_list::for_each_binned(float x, float y, Candidate&& f) const {
+	uint32_t buckets[9];
+	auto const count = buckets_around(x, y, buckets);
+	for (size_t b = 0; b < count; ++b) {
+		for (auto s = bucket_start[buckets[b]]; s < bucket_start[buckets[b] + 1]; ++s)
+			f(s);
+	}
+}
+
+template<typename Neighbour>
+void neighbour_list::for_each_neighbour(size_t i, Neighbour&& f) const {
+	auto const x = particles.x[i];
+	auto const y = particles.y[i];
+	auto const reach_squared = cutoff * cutoff;
+
+	if (listed_count != 0) {
+		for (auto l = list_start[i]; l < list_start[i + 1]; ++l) {
+			auto const j = listed[l];
+			auto const dx = particles.x[j] - x;
+			auto const dy = particles.y[j] - y;
+			if (dx * dx + dy * dy < reach_squared)
+				f(static_cast<size_t>(j));
+		}
+		return;
+	}
+
+	for_each_binned(x, y, [&](uint32_t s) {
+		auto const dx = sorted_x[s] - x;
+		auto const dy = sorted_y[s] - y;
+		if (sorted_index[s] != i and dx * dx + dy * dy < reach_squared)
+			f(static_cast<size_t>(sorted_index[s]));
+	});
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <compare>
+#include <cstddef>
+#include <iterator>
+
+// Splits the upper triangle of the N x N interaction matrix into square
+// tiles of index ranges. Tiles are numbered row by row and decoded on demand,
+// so only N and the tile size are stored and adding particles just means
+// constructing a new pair_tiles.
+class pair_tiles {
+public:
+	static constexpr size_t default_tile_size = 256;
+
+	struct tile {
+		size_t row_begin;
+		size_t row_end;
+		size_t column_begin;
+		size_t column_end;
+
+		bool on_diagonal() const noexcept {
+			return row_begin == column_begin;
+		}
+
+		// Calls f(i, j) once for every i < j in the tile.
+		template<typename Function>
+		void for_each_pair(Function&& f) const {
+			for (auto i = row_begin; i < row_end; ++i) {
+				auto const first_column = on_diagonal() ? i + 1 : column_begin;
+				for (auto j = first_column; j < column_end; ++j)
+					f(i, j);
+			}
+		}
+
+		size_t pair_count() const noexcept {
+			auto const rows = row_end - row_begin;
+			auto const columns = column_end - column_begin;
+			return on_diagonal() ? rows * (rows - 1) / 2 : rows * columns;
+		}
+	};
+
+	// Random access over tile numbers, so the parallel algorithms can split
+	// the range without the tiles ever being stored.
+	class iterator {
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = tile;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = tile;
+
+		iterator() noexcept : owner(nullptr), index(0) { }
+		iterator(pair_tiles const* owner, size_t index) noexcept : owner(owner), index(index) { }
+
+		tile operator*() const noexcept { return (*owner)[index]; }
+		tile operator[](difference_type n) const noexcept { return (*owner)[index + n]; }
+
+		iterator& operator++() noexcept { ++index; return *this; }
+		iterator operator++(int) noexcept { auto copy = *this; ++index; return copy; }
+		iterator& operator--() noexcept { --index; return *this; }
+		iterator operator--(int) noexcept { auto copy = *this; --index; return copy; }
+
+		iterator& operator+=(difference_type n) noexcept { index += n; return *this; }
+		iterator& operator-=(difference_type n) noexcept { index -= n; return *this; }
+		iterator operator+(difference_type n) const noexcept { return iterator(owner, index + n); }
+		iterator operator-(difference_type n) const noexcept { return iterator(owner, index - n); }
+		friend iterator operator+(difference_type n, iterator it) noexcept { return it + n; }
+
+		difference_type operator-(iterator const& other) const noexcept {
+			return static_cast<difference_type>(index) - static_cast<difference_type>(other.index);
+		}
+
+		bool operator==(iterator const& other) const noexcept { return index == other.index; }
+		auto operator<=>(iterator const& other) const noexcept { return index <=> other.index; }
+
+	private:
+		pair_tiles const* owner;
+		size_t index;
+	};
+
+	pair_tiles(size_t particle_count = 0, size_t tile_size = default_tile_size) noexcept
+		: particle_count(particle_count),
+		tile_size(tile_size == 0 ? 1 : tile_size),
+		tiles_per_side((particle_count + this->tile_size - 1) / this->tile_size) {
+	}
+
+	size_t size() const noexcept {
+		return tiles_per_side * (tiles_per_side + 1) / 2;
+	}
+
+	size_t get_particle_count() const noexcept {
+		return particle_count;
+	}
+
+	size_t get_tile_size() const noexcept {
+		return tile_size;
+	}
+
+	size_t pair_count() const noexcept {
+		return particle_count < 2 ? 0 : particle_count * (particle_count - 1) / 2;
+	}
+
+	iterator begin() const noexcept {
+		return iterator(this, 0);
+	}
+
+	iterator end() const noexcept {
+		return iterator(this, size());
+	}
+
+	tile operator[](size_t t) const noexcept {
+		// Row r holds tiles_per_side - r tiles, so the first tile of row r is
+		// r * T - r * (r - 1) / 2. Invert that with the quadratic formula and
+		// fix up the rounding.
+		auto const n = static_cast<double>(tiles_per_side);
+		auto row = static_cast<size_t>((2 * n + 1 - std::sqrt((2 * n + 1) * (2 * n + 1) - 8.0 * t)) / 2);
+
+		while (row > 0 and row_start(row) > t)
+			--row;
+		while (row + 1 < tiles_per_side and row_start(row + 1) <= t)
+			++row;
+
+		auto const column = row + (t - row_start(row));
+
+		return block_tile(row, column);
+	}
+
+	// The same tiles grouped into rounds in which no two tiles share a block
+	// of particles, so a round can run in parallel with every tile writing
+	// straight into the force columns. Round 0 is the diagonal; the others
+	// pair the blocks up round-robin (the circle method). Running the rounds
+	// in order adds up every particle's force in the same order no matter
+	// how many threads there are.
+	size_t round_count() const noexcept {
+		return tiles_per_side < 2 ? tiles_per_side : 1 + rotating_blocks();
+	}
+
+	size_t round_size(size_t round) const noexcept {
+		if (round == 0)
+			return tiles_per_side;
+		// With an odd block count one block sits every round out.
+		return (rotating_blocks() + 1) / 2 - (tiles_per_side % 2);
+	}
+
+	tile round_tile(size_t round, size_t k) const noexcept {
+		if (round == 0)
+			return block_tile(k, k);
+
+		auto const m = rotating_blocks();
+		auto const r = round - 1;
+		auto const i = k + tiles_per_side % 2;
+
+		// Pair 0 matches the fixed block against r, which with an odd block
+		// count is the made-up block that got skipped above.
+		auto const a = i == 0 ? m : (r + i) % m;
+		auto const b = i == 0 ? r : (r + m - i) % m;
+
+		return block_tile(std::min(a, b), std::max(a, b));
+	}
+
+private:
+	tile block_tile(size_t row, size_t column) const noexcept {
+		return tile{
+			row * tile_size,
+			std::min(particle_count, (row + 1) * tile_size),
+			column * tile_size,
+			std::min(particle_count, (column + 1) * tile_size)
+		};
+	}
+
+	// Blocks other than the fixed one in the round-robin, after rounding the
+	// block count up to even.
+	size_t rotating_blocks() const noexcept {
+		return tiles_per_side + tiles_per_side % 2 - 1;
+	}
+
+	size_t row_start(size_t row) const noexcept {
+		return row * tiles_per_side - row * (row - 1) / 2;
+	}
+
+	size_t particle_count;
+	size_t tile_size;
+	size_t tiles_per_side;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr float g = 0.00981f;
+constexpr float k = -89755.1f;
+constexpr float dt = 0.05f;
+
+// Raw pointers into the physics columns of the particle store, which is all
+// the force kernels get to see. Only valid until the next entity is added
+// or removed.
+struct particle_arrays {
+	size_t size;
+
+	float* x;
+	float* y;
+	float* vx;
+	float* vy;
+	float* ax;
+	float* ay;
+	float* fx;
+	float* fy;
+
+	float const* mass;
+	float const* charge;
+
+	// The particle store keeps the charged particles ahead of the neutral
+	// ones, and these are the first charged_count() of them, so laws that
+	// need charge have no pairs past it. Anything from size up means no
+	// such split is known, as for arrays put together by hand.
+	size_t charged = static_cast<size_t>(-1);
+
+	size_t charged_count() const noexcept {
+		return charged < size ? charged : size;
+	}
+
+	// Each particle's species id, and the species_table couplings they
+	// index, species_count to a row. Null when the species are not known.
+	uint8_t const* species = nullptr;
+	float const* couplings = nullptr;
+	size_t species_count = 0;
+};
@@ -0,0 +1,373 @@
+#include "particle_mesh.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+#include "index_range.hpp"
+
+namespace {
+
+	// erfc(alpha r) + 2 alpha r / sqrt(pi) e^(-alpha^2 r^2), the share of a
+	// pair force the direct part adds, as a function of u = (alpha r)^2 up
+	// to the cutoff. Interpolated from a table, as the two special functions
+	// per pair would otherwise cost more than the rest of the step.
+	class short_range_share {
+	public:
+		static constexpr size_t size = 4096;
+		static constexpr float last = particle_mesh::cutoff_ratio * particle_mesh::cutoff_ratio;
+
+		short_range_share() {
+			for (size_t t = 0; t <= size + 1; ++t) {
+				auto const u = static_cast<double>(t) * last / size;
+				auto const r = std::sqrt(u);
+				values[t] = static_cast<float>(std::erfc(r) + 2.0 * r * std::numbers::inv_sqrtpi * std::exp(-u));
+			}
+		}
+
+		float operator()(float u) const noexcept {
+			auto const position = std::min(u, last) * (size / last);
+			auto const t = static_cast<size_t>(position);
+			auto const f = position - static_cast<float>(t);
+			return values[t] + f * (values[t + 1] - values[t]);
+		}
+
+	private:
+		float values[size + 2];
+	};
+
+	short_range_share const& share() {
+		static short_range_share const table;
+		return table;
+	}
+
+}
+
+char const* mesh_assignment_name(mesh_assignment assignment) noexcept {
+	return assignment == mesh_assignment::cloud_in_cell ? "CIC" : "TSC";
+}
+
+particle_mesh::stencil particle_mesh::stencil_of(float u) const noexcept {
+	if (assignment == mesh_assignment::cloud_in_cell) {
+		auto const first = std::floor(u);
+		auto const f = u - first;
+		return { static_cast<int>(first), { 1.f - f, f, 0.f } };
+	}
+
+	auto const nearest = std::floor(u + 0.5f);
+	auto const d = u - nearest;
+	return { static_cast<int>(nearest) - 1, { 0.5f * (0.5f - d) * (0.5f - d), 0.75f - d * d, 0.5f * (0.5f + d) * (0.5f + d) } };
+}
+
+void particle_mesh::prepare_kernels(thread_pool& pool) {
+	auto const m = padded;
+	plan = fft_plan(m);
+	kernel_x.assign(m * m, {});
+	kernel_y.assign(m * m, {});
+
+	// The field at mesh point X of a unit source at Y is (Y - X) D(|Y - X|),
+	// the gradient of erf(alpha r) / r, with
+	//     D(r) = erf(alpha r) / r^3 - 2 alpha / sqrt(pi) e^(-alpha^2 r^2) / r^2.
+	// As a convolution over X - Y that is -d D(|d|), with offsets d wrapped
+	// into the padded mesh. The row and column at offset m / 2 are their
+	// own mirror image, so they are left zero to keep the kernel odd; no two
+	// points of the unpadded mesh are that far apart anyway. Otherwise the
+	// division by the window below spreads their even part back over short
+	// offsets, where it pushes every particle on itself.
+	auto const alpha = 1.0 / split;
+	auto const gaussian_scale = 2.0 * alpha * std::numbers::inv_sqrtpi;
+	auto const signed_offset = [m](size_t index) {
+		return index < m / 2 ? static_cast<double>(index) : static_cast<double>(index) - static_cast<double>(m);
+	};
+
+	pool.for_each(index_range(m), [&](size_t row) {
+		auto const dy = signed_offset(row);
+		for (size_t column = 0; column < m; ++column) {
+			auto const dx = signed_offset(column);
+			auto const r_squared = dx * dx + dy * dy;
+			if (r_squared == 0.0 or row == m / 2 or column == m / 2)
+				continue;
+
+			auto const r = std::sqrt(r_squared);
+			auto const d = std::erf(alpha * r) / (r_squared * r) - gaussian_scale * std::exp(-alpha * alpha * r_squared) / r_squared;
+			kernel_x[row * m + column] = -dx * d;
+			kernel_y[row * m + column] = -dy * d;
+		}
+	}, 1);
+
+	forward_2d(pool, plan, kernel_x.data(), m);
+	forward_2d(pool, plan, kernel_y.data(), m);
+
+	// Spreading and reading back each smooth the field by the assignment
+	// window, sinc^2 per axis for CIC and sinc^3 for TSC, so the kernel is
+	// divided by it twice to undo that to leading order. The Gaussian in
+	// the kernel keeps this from blowing up the highest frequencies. The
+	// inverse transform is unscaled, so that is folded in too.
+	auto const scale = 1.0 / static_cast<double>(m * m);
+	auto const power = assignment == mesh_assignment::cloud_in_cell ? 2 : 3;
+	auto const window = [m, power](size_t index) {
+		auto const theta = std::numbers::pi * static_cast<double>(index < m / 2 ? index : m - index) / static_cast<double>(m);
+		auto const sinc = theta == 0.0 ? 1.0 : std::sin(theta) / theta;
+		return std::pow(sinc, power);
+	};
+	for (size_t row = 0; row < m; ++row) {
+		auto const wy = window(row);
+		for (size_t column = 0; column < m; ++column) {
+			auto const w = wy * window(column);
+			auto const factor = scale / (w * w);
+			kernel_x[row * m + column] *= factor;
+			kernel_y[row * m + column] *= factor;
+		}
+	}
+}
+
+void particle_mesh::place_mesh(particle_arrays const& p) {
+	auto const n = p.size;
+
+	// The q and 1 - q quantiles of one coordinate, in O(N).
+	auto const bulk_of = [this, n](float const* values) {
+		quantile_scratch.assign(values, values + n);
+		auto const low = static_cast<size_t>(bulk_quantile * static_cast<float>(n - 1));
+		auto const high = n - 1 - low;
+		std::nth_element(quantile_scratch.begin(), quantile_scratch.begin() + low, quantile_scratch.end());
+		auto const lower = quantile_scratch[low];
+		std::nth_element(quantile_scratch.begin() + low, quantile_scratch.begin() + high, quantile_scratch.end());
+		auto const upper = quantile_scratch[high];
+		return std::pair(lower - (upper - lower), upper + (upper - lower));
+	};
+
+	auto const [low_x, high_x] = bulk_of(p.x);
+	auto const [low_y, high_y] = bulk_of(p.y);
+
+	on_mesh.clear();
+	outside.clear();
+	is_on_mesh.resize(n);
+	float min_x = std::numeric_limits<float>::max();
+	float min_y = std::numeric_limits<float>::max();
+	float max_x = std::numeric_limits<float>::lowest();
+	float max_y = std::numeric_limits<float>::lowest();
+
+	for (size_t i = 0; i < n; ++i) {
+		auto const x = p.x[i];
+		auto const y = p.y[i];
+		if (low_x <= x and x <= high_x and low_y <= y and y <= high_y) {
+			is_on_mesh[i] = 1;
+			on_mesh.push_back(static_cast<uint32_t>(i));
+			min_x = std::min(min_x, x);
+			min_y = std::min(min_y, y);
+			max_x = std::max(max_x, x);
+			max_y = std::max(max_y, y);
+		}
+		else {
+			is_on_mesh[i] = 0;
+			outside.push_back(static_cast<uint32_t>(i));
+		}
+	}
+
+	// Square cells with a cell of room on every side, which is all either
+	// stencil reaches past the cell a particle is in.
+	auto const extent = std::max({ max_x - min_x, max_y - min_y, 1e-3f });
+	h = extent / static_cast<float>(cells - 3) * 1.0001f;
+	origin_x = min_x - h;
+	origin_y = min_y - h;
+}
+
+void particle_mesh::build(thread_pool& pool, particle_arrays const& p, settings const& options) {
+	particles = p;
+	assignment = options.assignment;
+	points = assignment == mesh_assignment::cloud_in_cell ? 2 : 3;
+
+	auto const n = p.size;
+	on_mesh.clear();
+	outside.clear();
+	if (n == 0)
+		return;
+
+	auto const automatic = std::min(max_automatic_cells, static_cast<size_t>(std::sqrt(static_cast<float>(n))));
+	auto const wanted_cells = std::bit_ceil(std::clamp(options.cells != 0 ? options.cells : automatic, min_cells, max_cells));
+	auto const wanted_split = std::max(options.split, 0.25f);
+	if (wanted_cells != cells or wanted_split != split or assignment != kernel_assignment) {
+		cells = wanted_cells;
+		padded = 2 * cells;
+		split = wanted_split;
+		kernel_assignment = assignment;
+		prepare_kernels(pool);
+	}
+
+	place_mesh(p);
+
+	// The transforms leave the whole padded mesh dirty.
+	auto const m = padded;
+	density.assign(m * m, {});
+
+	// In particle order, so the mesh comes out the same on any thread count.
+	auto const inverse_h = 1.f / h;
+	for (auto const i : on_mesh) {
+		auto const sx = stencil_of((p.x[i] - origin_x) * inverse_h);
+		auto const sy = stencil_of((p.y[i] - origin_y) * inverse_h);
+		fft_plan::complex const amount(p.mass[i], p.charge[i]);
+
+		for (int b = 0; b < points; ++b) {
+			auto* const row = density.data() + static_cast<size_t>(sy.first + b) * m + sx.first;
+			for (int a = 0; a < points; ++a)
+				row[a] += static_cast<double>(sy.weights[b] * sx.weights[a]) * amount;
+		}
+	}
+
+	forward_2d(pool, plan, density.data(), cells);
+
+	field_x.resize(m * m);
+	field_y.resize(m * m);
+	pool.for_each(index_range(m), [this, m](size_t row) {
+		for (auto index = row * m; index < (row + 1) * m; ++index) {
+			field_x[index] = density[index] * kernel_x[index];
+			field_y[index] = density[index] * kernel_y[index];
+		}
+	}, 1);
+
+	inverse_2d(pool, plan, field_x.data(), cells);
+	inverse_2d(pool, plan, field_y.data(), cells);
+
+	sort_into_chains();
+}
+
+void particle_mesh::sort_into_chains() {
+	auto const& p = particles;
+	auto const reach = cutoff();
+	chains_per_side = std::max<size_t>(1, static_cast<size_t>(static_cast<float>(cells) * h / reach));
+	chain_size = static_cast<float>(cells) * h / static_cast<float>(chains_per_side);
+
+	// A counting sort: count, prefix sum, then place.
+	chain_start.assign(chains_per_side * chains_per_side + 1, 0);
+	chain_of.resize(on_mesh.size());
+	for (size_t s = 0; s < on_mesh.size(); ++s) {
+		auto const i = on_mesh[s];
+		auto const column = std::min(chains_per_side - 1, static_cast<size_t>((p.x[i] - origin_x) / chain_size));
+		auto const row = std::min(chains_per_side - 1, static_cast<size_t>((p.y[i] - origin_y) / chain_size));
+		chain_of[s] = static_cast<uint32_t>(row * chains_per_side + column);
+		++chain_start[chain_of[s] + 1];
+	}
+	for (size_t c = 1; c < chain_start.size(); ++c)
+		chain_start[c] += chain_start[c - 1];
+
+	chained_index.resize(on_mesh.size());
+	chained_x.resize(on_mesh.size());
+	chained_y.resize(on_mesh.size());
+	chained_mass.resize(on_mesh.size());
+	chained_charge.resize(on_mesh.size());
+
+	// Placing moves each chain's start up to the next one's, so they are
+	// shifted back down after.
+	for (size_t s = 0; s < on_mesh.size(); ++s) {
+		auto const i = on_mesh[s];
+		auto const to = chain_start[chain_of[s]]++;
+		chained_index[to] = i;
+		chained_x[to] = p.x[i];
+		chained_y[to] = p.y[i];
+		chained_mass[to] = p.mass[i];
+		chained_charge[to] = p.charge[i];
+	}
+	for (auto c = chain_start.size() - 1; c > 0; --c)
+		chain_start[c] = chain_start[c - 1];
+	chain_start[0] = 0;
+}
+
+mathematics::vector<float, 2> particle_mesh::force_on(size_t i, size_t* interactions) const noexcept {
+	mathematics::vector<float, 2> force;
+	auto const& p = particles;
+	if (i >= p.size or is_on_mesh.size() != p.size)
+		return force;
+
+	auto const x = p.x[i];
+	auto const y = p.y[i];
+	auto const m = p.mass[i];
+	auto const q = p.charge[i];
+
+	float fx = 0.f;
+	float fy = 0.f;
+	size_t terms = 0;
+
+	auto const add_pair = [&](size_t j) {
+		auto const dx = p.x[j] - x;
+		auto const dy = p.y[j] - y;
+		auto const dist_squared = dx * dx + dy * dy;
+		auto const dist = std::sqrt(dist_squared);
+		auto const scale = (g * m * p.mass[j] + k * q * p.charge[j]) / (dist_squared * dist);
+		fx += scale * dx;
+		fy += scale * dy;
+	};
+
+	if (!is_on_mesh[i]) {
+		for (size_t j = 0; j < p.size; ++j) {
+			if (j != i)
+				add_pair(j);
+		}
+		terms = p.size - 1;
+	}
+	else {
+		// Mesh part, with the mesh's fields in cell units scaled back by
+		// 1 / h^2.
+		auto const inverse_h = 1.f / h;
+		auto const sx = stencil_of((x - origin_x) * inverse_h);
+		auto const sy = stencil_of((y - origin_y) * inverse_h);
+
+		fft_plan::complex ex;
+		fft_plan::complex ey;
+		for (int b = 0; b < points; ++b) {
+			auto const offset = static_cast<size_t>(sy.first + b) * padded + sx.first;
+			for (int a = 0; a < points; ++a) {
+				auto const w = static_cast<double>(sy.weights[b] * sx.weights[a]);
+				ex += w * field_x[offset + a];
+				ey += w * field_y[offset + a];
+			}
+		}
+
+		auto const mesh_scale = inverse_h * inverse_h;
+		fx = static_cast<float>(mesh_scale * (g * m * ex.real() + k * q * ex.imag()));
+		fy = static_cast<float>(mesh_scale * (g * m * ey.real() + k * q * ey.imag()));
+
+		// Direct part, the rest of each pair force, over the neighbours on
+		// the mesh within the cutoff.
+		auto const alpha_squared = 1.f / (split * split * h * h);
+		auto const& direct_share = share();
+		auto const reach_squared = cutoff() * cutoff();
+		size_t visited = 0;
+
+		auto const column = std::min(chains_per_side - 1, static_cast<size_t>((x - origin_x) / chain_size));
+		auto const row = std::min(chains_per_side - 1, static_cast<size_t>((y - origin_y) / chain_size));
+		for (auto r = row == 0 ? 0 : row - 1; r <= std::min(row + 1, chains_per_side - 1); ++r) {
+			auto const first = chain_start[r * chains_per_side + (column == 0 ? 0 : column - 1)];
+			auto const last = chain_start[r * chains_per_side + std::min(column + 1, chains_per_side - 1) + 1];
+			visited += last - first;
+
+			// The chains along a row are next to each other in the sort.
+			for (auto s = first; s < last; ++s) {
+				auto const dx = chained_x[s] - x;
+				auto const dy = chained_y[s] - y;
+				auto const dist_squared = dx * dx + dy * dy;
+				if (dist_squared >= reach_squared or chained_index[s] == i)
+					continue;
+
+				auto const dist = std::sqrt(dist_squared);
+				auto const coupling = g * m * chained_mass[s] + k * q * chained_charge[s];
+				auto const scale = coupling * direct_share(alpha_squared * dist_squared) / (dist_squared * dist);
+				fx += scale * dx;
+				fy += scale * dy;
+			}
+		}
+
+		for (auto const j : outside)
+			add_pair(j);
+
+		terms = static_cast<size_t>(points * points) + visited + outside.size();
+	}
+
+	if (interactions)
+		*interactions += terms;
+
+	force[0] = fx;
+	force[1] = fy;
+	return force;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "fft.hpp"
+#include "mathematics.hpp"
+#include "particle_arrays.hpp"
+#include "thread_pool.hpp"
+
+// How mass and charge are spread over the mesh, and forces read back from
+// it: cloud-in-cell shares a particle between the 4 nearest mesh points,
+// triangular-shaped cloud between the 9 nearest, which is smoother and
+// aliases less.
+enum class mesh_assignment : uint8_t {
+	cloud_in_cell,
+	triangular_shaped_cloud
+};
+
+char const* mesh_assignment_name(mesh_assignment assignment) noexcept;
+
+// Gravity and Coulomb forces by particle-particle particle-mesh (P3M). The
+// 1/r potential is split as erf(alpha r) / r + erfc(alpha r) / r. The first
+// part is smooth, so it is sampled on a mesh over the particles' bounding
+// box and convolved with the mass and charge deposited there by FFT,
+// zero padded to twice the mesh so the particles see no periodic images.
+// The second dies off within a few mesh cells and is summed directly over
+// the neighbours a chaining mesh finds. Build is O(N + M^2 log M) for an M x M
+// mesh, and each force_on then touches a bounded number of particles if the
+// cloud is fairly uniform, so a step is O(N log N) overall. Tight clusters
+// crowd the direct part instead; Barnes-Hut copes with those better.
+//
+// The mesh only covers the bulk of the particles, as a few flung far out
+// would otherwise stretch it until every pair is a neighbour. Those outside
+// interact with everyone directly instead, and everyone with them.
+//
+// The mesh forces come from convolving with the gradient of the kernel
+// rather than differencing a potential, and are read back with the same
+// weights they were spread with. The kernel is kept exactly odd, so in
+// exact arithmetic the mesh force between two particles is antisymmetric
+// and a particle's force on itself cancels. The transforms only come close
+// to that: their rounding error scales with the largest mass or charge
+// deposited, so a particle's leftover force on itself goes with its mass
+// squared. The convolution runs in double, where even one very heavy body
+// among light ones pushes on itself with far less than the rest of the
+// error.
+class particle_mesh {
+public:
+	struct settings {
+		// Mesh points per side, rounded up to a power of two. 0 picks the
+		// power of two at or above sqrt(N), so one to four mesh points per
+		// particle, which balances the transforms against the direct part
+		// for an even spread.
+		size_t cells = 0;
+
+		mesh_assignment assignment = mesh_assignment::triangular_shaped_cloud;
+
+		// 1 / alpha in mesh cells. Larger moves more of the force onto the
+		// direct part and makes the mesh part more accurate.
+		float split = 1.5f;
+	};
+
+	static constexpr size_t min_cells = 16;
+	static constexpr size_t max_cells = 2048;
+	static constexpr size_t max_automatic_cells = 1024;
+
+	// The mesh spans the middle 98% of the particles along each axis and as
+	// much again on either side, so only particles well clear of the rest
+	// fall outside it.
+	static constexpr float bulk_quantile = 0.01f;
+
+	// Pairs further apart than this many times 1 / alpha are left out of
+	// the direct part; erfc(3.5) and the Gaussian term it comes with are
+	// both below 2e-5 of the pair force there.
+	static constexpr float cutoff_ratio = 3.5f;
+
+	// Deposits, solves and indexes the particles for force_on. The arrays
+	// must stay valid until then.
+	void build(thread_pool& pool, particle_arrays const& particles, settings const& options);
+
+	// Gravity plus Coulomb force on the particle with dense index i at the
+	// time of build(). If interactions is given, the number of mesh points
+	// and particles looked at is added to it.
+	mathematics::vector<float, 2> force_on(size_t i, size_t* interactions = nullptr) const noexcept;
+
+	// Physical size of a mesh cell, and the distance the direct part
+	// reaches, as of the last build.
+	float cell_size() const noexcept {
+		return h;
+	}
+
+	size_t mesh_cells() const noexcept {
+		return cells;
+	}
+
+	// Particles left off the mesh in the last build.
+	size_t outside_count() const noexcept {
+		return outside.size();
+	}
+
+	float cutoff() const noexcept {
+		return cutoff_ratio * split * h;
+	}
+
+private:
+	// The first of the 2 or 3 mesh points a coordinate u, in cells, is
+	// spread over along one axis, and their weights.
+	struct stencil {
+		int first;
+		float weights[3];
+	};
+
+	stencil stencil_of(float u) const noexcept;
+
+	// Spectra of the x and y field kernels for the current cells, split and
+	// assignment, ready to multiply a deposited spectrum with.
+	void prepare_kernels(thread_pool& pool);
+
+	// Sets the mesh box and sorts the particles into on and outside it.
+	void place_mesh(particle_arrays const& p);
+
+	particle_arrays particles{};
+	mesh_assignment assignment = mesh_assignment::triangular_shaped_cloud;
+	int points = 3;
+
+	size_t cells = 0;
+	size_t padded = 0;
+	float split = 0.f;
+	float h = 1.f;
+	float origin_x = 0.f;
+	float origin_y = 0.f;
+
+	fft_plan plan;
+	mesh_assignment kernel_assignment = mesh_assignment::triangular_shaped_cloud;
+	std::vector<fft_plan::complex> kernel_x;
+	std::vector<fft_plan::complex> kernel_y;
+
+	// Mass deposited as the real part and charge as the imaginary part, so
+	// one transform carries both; the kernels are real, so they stay apart.
+	// All in double, see above.
+	std::vector<fft_plan::complex> density;
+	std::vector<fft_plan::complex> field_x;
+	std::vector<fft_plan::complex> field_y;
+
+	// Dense indices of the particles on and outside the mesh, and for every
+	// particle whether it is on it.
+	std::vector<uint32_t> on_mesh;
+	std::vector<uint32_t> outside;
+	std::vector<uint8_t> is_on_mesh;
+	std::vector<float> quantile_scratch;
+
+	// The chaining mesh: the particles on the mesh sorted into square
+	// chains at least the cutoff wide, so a particle's neighbours are all in
+	// its own chain and the 8 around it.
+	void sort_into_chains();
+
+	size_t chains_per_side = 0;
+	float chain_size = 1.f;
+	std::vector<uint32_t> chain_start;
+	std::vector<uint32_t> chain_of;
+	std::vector<uint32_t> chained_index;
+	std::vector<float> chained_x;
+	std::vector<float> chained_y;
+	std::vector<float> chained_mass;
+	std::vector<float> chained_charge;
+};
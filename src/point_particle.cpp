@@ -1,71 +1,92 @@
 #include "point_particle.hpp"
 
-#include <fmt/format.h>
+#include "force_laws.hpp"
 
-using mathematics::vector;
+#include <algorithm>
 
-std::tuple < float, vector<float,2>, vector<float,2> > distance_between_and_difference(point_particle const& p1, point_particle const& p2) {
-	auto const & pos1 = p1.get_value<NewtonianBody>()->position;
-	auto const & pos2 = p2.get_value<NewtonianBody>()->position;
+#include <fmt/format.h>
 
-	auto diff = pos2 - pos1;
-	auto dist = mathematics::hypotenuse(diff);
-	auto unit_vector_of_diff = (1/dist)*diff;
+using mathematics::vector;
 
-	return std::make_tuple(dist, diff, unit_vector_of_diff);
+particle_arrays get_particle_arrays(EntityManagerType& manager) noexcept {
+	return particle_arrays{
+		manager.size(),
+		manager.get_storage_for_component<PositionX>().data(),
+		manager.get_storage_for_component<PositionY>().data(),
+		manager.get_storage_for_component<VelocityX>().data(),
+		manager.get_storage_for_component<VelocityY>().data(),
+		manager.get_storage_for_component<AccelerationX>().data(),
+		manager.get_storage_for_component<AccelerationY>().data(),
+		manager.get_storage_for_component<ForceX>().data(),
+		manager.get_storage_for_component<ForceY>().data(),
+		manager.get_storage_for_component<Mass>().data(),
+		manager.get_storage_for_component<Charge>().data(),
+		charged_count(manager)
+	};
 }
 
-bool compare_by_distance(std::pair<point_particle*, point_particle*> const & pair1, std::pair<point_particle*, point_particle*> const & pair2) {
-	auto [dist1, diff1, unit_diff1] = distance_between_and_difference(* pair1.first, * pair1.second);
-	auto [dist2, diff2, unit_diff2] = distance_between_and_difference(* pair2.first, * pair2.second);
-	return dist1 < dist2;
-};
-
-
-void mass_interaction(point_particle* p1, point_particle * p2) {
-	auto [dist, dir, unit_dir] = distance_between_and_difference(*p1, *p2);
-
-	auto& pc1 = *p1->get_value<PhysicalComponent>();
-	auto& pc2 = *p2->get_value<PhysicalComponent>();
-
-	auto const m1 = pc1.mass;
-	auto const m2 = pc2.mass;
+particle_arrays get_particle_arrays(EntityManagerType& manager, species_table const& table) noexcept {
+	auto p = get_particle_arrays(manager);
+	if (!table.overflowed() and table.couplings()) {
+		p.species = manager.get_storage_for_component<Species>().data();
+		p.couplings = table.couplings();
+		p.species_count = table.size();
+	}
+	return p;
+}
 
-	auto const force = (g * m1 * m2) / (dist * dist);
-	vector<float, 2> vector_force = force * unit_dir;
+point_particle add_particle(EntityManagerType& manager, species_table& table, float x, float y, float mass, float charge) {
+	auto const split = charged_count(manager);
+	auto const added = manager.push_back(x, y, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, mass, charge, table.id_of(mass, charge), Selectable());
 
-	auto& vector_force_array1 = *(pc1.shared_force);
-	auto& vector_force_array2 = *(pc2.shared_force);
+	// A charged newcomer trades places with the first neutral particle.
+	if (charge != 0.f)
+		manager.swap_entities(split, manager.size() - 1);
 
-	for (auto i = 0; i < 2; ++i)
-		vector_force_array1[i] += vector_force[i];
-	for (auto i = 0; i < 2; ++i)
-		vector_force_array2[i] -= vector_force[i];
-};
+	return added;
+}
 
-void electrical_interaction(point_particle * p1, point_particle* p2) {
-	auto [dist, dir, unit_dir] = distance_between_and_difference(*p1, *p2);
+size_t charged_count(EntityManagerType const& manager) noexcept {
+	auto const charges = manager.get_storage_for_component<Charge>();
+	return static_cast<size_t>(std::partition_point(charges.begin(), charges.end(), [](float q) { return q != 0.f; }) - charges.begin());
+}
 
-	auto& pc1 = *p1->get_value<PhysicalComponent>();
-	auto& pc2 = *p2->get_value<PhysicalComponent>();
+void partition_by_charge(EntityManagerType& manager) {
+	auto const charges = manager.get_storage_for_component<Charge>();
+	size_t split = 0;
+	for (size_t i = 0; i < charges.size(); ++i) {
+		if (charges[i] != 0.f)
+			manager.swap_entities(split++, i);
+	}
+}
 
-	auto const m1 = pc1.mass;
-	auto const m2 = pc2.mass;
+void assign_species(EntityManagerType& manager, species_table& table) {
+	auto const masses = manager.get_storage_for_component<Mass>();
+	auto const charges = manager.get_storage_for_component<Charge>();
+	auto const ids = manager.get_storage_for_component<Species>();
+	for (size_t i = 0; i < ids.size(); ++i)
+		ids[i] = table.id_of(masses[i], charges[i]);
+}
 
-	auto& ec1 = *p1->get_value<ElectricalComponent>();
-	auto& ec2 = *p2->get_value<ElectricalComponent>();
+std::tuple < float, vector<float,2>, vector<float,2> > distance_between_and_difference(particle_arrays const& p, size_t i, size_t j) {
+	vector<float, 2> diff{ p.x[j] - p.x[i], p.y[j] - p.y[i] };
+	auto dist = mathematics::hypotenuse(diff);
+	auto unit_vector_of_diff = (1/dist)*diff;
 
-	auto const c1 = ec1.charge;
-	auto const c2 = ec2.charge;
+	return std::make_tuple(dist, diff, unit_vector_of_diff);
+}
 
+bool compare_by_distance(particle_arrays const& p, std::pair<size_t, size_t> const& pair1, std::pair<size_t, size_t> const& pair2) {
+	auto [dist1, diff1, unit_diff1] = distance_between_and_difference(p, pair1.first, pair1.second);
+	auto [dist2, diff2, unit_diff2] = distance_between_and_difference(p, pair2.first, pair2.second);
+	return dist1 < dist2;
+};
 
-	auto const scalar_force = (k * c1 * c2) / (dist * dist);
 
-	vector<float, 2> vector_force = scalar_force * unit_dir;
+vector<float, 2> mass_interaction(particle_arrays const& p, size_t i, size_t j) {
+	return fused_interaction<ListsViaTypes::TypeList<force_laws::gravity>>::force(p, i, j);
+};
 
-	for (auto i = 0; i < 2; ++i)
-		(*pc1.shared_force)[i] += vector_force[i];
-	for (auto i = 0; i < 2; ++i)
-		(*pc2.shared_force)[i] -= vector_force[i];
+vector<float, 2> electrical_interaction(particle_arrays const& p, size_t i, size_t j) {
+	return fused_interaction<ListsViaTypes::TypeList<force_laws::coulomb>>::force(p, i, j);
 }
-
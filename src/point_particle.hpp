@@ -5,68 +5,71 @@
 #include <thread>
 #include <tuple>
 
-#include <SFML/Graphics.hpp>
-#include <SFML/Main.hpp>
-#include <SFML/Window.hpp>
-
 #include "entity.hpp"
 #include "mathematics.hpp"
-
-
-constexpr float g = 0.00981f;
-constexpr float k = -89755.1f;
-constexpr float dt = 0.05f;
-
-struct NewtonianBody {
-	NewtonianBody() = delete;
-	NewtonianBody(NewtonianBody const&) = delete;
-	NewtonianBody& operator=(NewtonianBody const&) = delete;
-
-	NewtonianBody(NewtonianBody&&) = default;
-	NewtonianBody& operator=(NewtonianBody&&) = default;
-
-	NewtonianBody(float x, float y, float mass)
-		: mass(mass), shared_force(std::make_unique<std::array<std::atomic<float>,2>>()) {
-		position[0] = x;
-		position[1] = y;
-		(*shared_force)[0] = 0;
-		(*shared_force)[1] = 0;
-	}
-
-	template<mathematics::concepts::FieldLike T>
-	using coordinate = typename mathematics::vector<T,2>;
-
-	coordinate<float> position;
-	coordinate<float> velocity;
-	coordinate<float> acceleration;
-
-	const float mass;
-
-	std::unique_ptr<std::array<std::atomic<float>,2>> shared_force;
-};
-
-struct PointCharge {
-	PointCharge(float charge) noexcept : charge(charge) { }
-
-	const float charge;
-};
-
+#include "particle_arrays.hpp"
+#include "species.hpp"
+
+// The Newtonian body and point charge of a particle are split into one
+// column per scalar, so the force kernels stream only the floats they use.
+// The name identifies the column in checkpoints.
+struct PositionX { using column_type = float; static constexpr char const* name = "position_x"; };
+struct PositionY { using column_type = float; static constexpr char const* name = "position_y"; };
+struct VelocityX { using column_type = float; static constexpr char const* name = "velocity_x"; };
+struct VelocityY { using column_type = float; static constexpr char const* name = "velocity_y"; };
+struct AccelerationX { using column_type = float; static constexpr char const* name = "acceleration_x"; };
+struct AccelerationY { using column_type = float; static constexpr char const* name = "acceleration_y"; };
+struct ForceX { using column_type = float; static constexpr char const* name = "force_x"; };
+struct ForceY { using column_type = float; static constexpr char const* name = "force_y"; };
+struct Mass { using column_type = float; static constexpr char const* name = "mass"; };
+struct Charge { using column_type = float; static constexpr char const* name = "charge"; };
+
+// The particle's id in a species_table, which follows from its mass and
+// charge.
+struct Species { using column_type = uint8_t; static constexpr char const* name = "species"; };
+
+// How a selected particle is highlighted is up to the front end.
 struct Selectable {
-	Selectable() noexcept : selected(false), highlight_color(sf::Color::Yellow) { }
+	Selectable() noexcept : selected(false) { }
 	bool selected;
-	sf::Color highlight_color;
 };
 
-using PhysicalComponent = NewtonianBody;
-
-using ElectricalComponent = PointCharge;
-
-using GraphicComponent = sf::CircleShape;
-
-using point_particle = Entity<ListsViaTypes::TypeList<PhysicalComponent, ElectricalComponent, Selectable, GraphicComponent>>;
-using EntityManagerType = EntityManager<point_particle, std::vector>;
-
-std::tuple < float, mathematics::vector<float,2>, mathematics::vector<float, 2> > distance_between_and_difference(point_particle const& p1, point_particle const& p2);
-bool compare_by_distance(std::pair<point_particle *,point_particle *> const& pair1, std::pair<point_particle *, point_particle *> const& pair2);
-void mass_interaction(point_particle* p1, point_particle* p2);
-void electrical_interaction(point_particle* p1, point_particle* p2);
+using point_particle_components = ListsViaTypes::TypeList<
+	PositionX, PositionY,
+	VelocityX, VelocityY,
+	AccelerationX, AccelerationY,
+	ForceX, ForceY,
+	Mass, Charge,
+	Species,
+	Selectable>;
+
+using EntityManagerType = ColumnarEntityManager<point_particle_components>;
+using point_particle = EntityManagerType::handle;
+
+particle_arrays get_particle_arrays(EntityManagerType& manager) noexcept;
+
+// The same with the species filled in, unless the table overflowed or has
+// no couplings.
+particle_arrays get_particle_arrays(EntityManagerType& manager, species_table const& table) noexcept;
+
+// Particles are kept charged first, then neutral. add_particle places each
+// new one on its side with at most one swap; charged_count finds the split
+// by binary search.
+point_particle add_particle(EntityManagerType& manager, species_table& table, float x, float y, float mass, float charge);
+size_t charged_count(EntityManagerType const& manager) noexcept;
+
+// Restores that order after the columns were filled some other way, as by
+// loading a checkpoint.
+void partition_by_charge(EntityManagerType& manager);
+
+// Sets every particle's species from its mass and charge, registering any
+// new ones, for columns filled some other way.
+void assign_species(EntityManagerType& manager, species_table& table);
+
+std::tuple < float, mathematics::vector<float,2>, mathematics::vector<float, 2> > distance_between_and_difference(particle_arrays const& p, size_t i, size_t j);
+bool compare_by_distance(particle_arrays const& p, std::pair<size_t, size_t> const& pair1, std::pair<size_t, size_t> const& pair2);
+
+// Force on particle i due to particle j. The force on j is the negation.
+// Single-law wrappers around force_laws.hpp; the pair pass uses pair_force.
+mathematics::vector<float, 2> mass_interaction(particle_arrays const& p, size_t i, size_t j);
+mathematics::vector<float, 2> electrical_interaction(particle_arrays const& p, size_t i, size_t j);
@@ -1,22 +1,22 @@
 #include "sim.hpp"
 
-#include <tuple>
-#include <numbers>
+#include "checkpoint.hpp"
 
 #include <fmt/format.h>
 
 point_particle_simulator::point_particle_simulator()
-	: mt(rd()),
-	delta_dist(-1.0, 1.0),
-	window(sf::VideoMode(width, height), "Particle simulator"),
+	: window(sf::VideoMode(width, height), "Particle simulator"),
 	v(sf::FloatRect(0, 0, width, height)),
+	particle_vertices(sf::Triangles),
 	approx_fps(0.f),
-	zoom_factor(1.0f)
+	zoom_factor(1.0f),
+	runner(physics)
 	{
 	
 	if (!font.loadFromFile("sansation.ttf"))
 		fmt::print("Font failed to load\n");
 
+	fmt::print("Vectorized direct sum uses {}\n", simd_level_name(best_simd_level()));
 
 	v.zoom(zoom_factor);
 
@@ -29,72 +29,34 @@ void point_particle_simulator::select(sf::Vector2f end_pos, sf::Vector2f start_p
 	if (!l.owns_lock())
 		return;
 
-	std::atomic<size_t> hits = 0;
-
-	auto is_in_the_box = [start_pos, end_pos, this](point_particle const* e) mutable -> bool {
-		auto const& nc = *e->get_value<NewtonianBody>();
-
-		auto lx = std::min(start_pos.x, end_pos.x);
-		auto bx = std::max(start_pos.x, end_pos.x);
-		auto ly = std::min(start_pos.y, end_pos.y);
-		auto by = std::max(start_pos.y, end_pos.y);
-
-		if (lx <= nc.position[0] and nc.position[0] <= bx and ly <= nc.position[1] and nc.position[1] <= by) {
-			return true;
-		}
-		return false;
-	};
-
-	auto const select = [this, is_in_the_box](std::unique_ptr<point_particle>const& e) mutable {
-		if (is_in_the_box(e.get())) {
-			auto& nc = *e->get_value<NewtonianBody>();
-			auto& sel = *e->get_value<Selectable>();
-			auto& gfx_cmp = *e->get_value<GraphicComponent>();
-			sel.selected = true;
-			auto cur_color = gfx_cmp.getFillColor();
-			auto hl_color = sel.highlight_color;
-			std::swap(cur_color, hl_color);
-			gfx_cmp.setFillColor(cur_color);
-			sel.highlight_color = hl_color;
-
-			current_selection.push_back(e.get());
-		}
-	};
-
-
-	std::for_each(std::execution::seq, manager.get_storage_for_entities().begin(), manager.get_storage_for_entities().end(), select);
-	fmt::print("Selected {} particles\n", current_selection.size());
-	std::thread get_statistics([this, l = std::move(l)]() {
-		float total_mass = 0;
-		float total_charge = 0;
-		float total_scalar_momentum = 0;
-		for (auto* p : current_selection) {
-			auto& nc = *p->get_component<PhysicalComponent>();
-			auto& ec = *p->get_component<ElectricalComponent>();
-			total_mass += nc.mass;
-			total_charge += ec.charge;
-			total_scalar_momentum += nc.mass * (std::hypotf(nc.velocity[0], nc.velocity[1]));
-		}
+	auto& manager = physics.manager;
+	auto const selectables = manager.get_storage_for_component<Selectable>();
+
+	// Select from what is on screen rather than the columns the simulation
+	// thread is writing to. The snapshot's grid makes both the hit list and
+	// the totals cost about the size of the selection, not the scene.
+	auto const& snapshot = runner.latest();
+	for (auto const i : snapshot.grid.query_box(start_pos.x, start_pos.y, end_pos.x, end_pos.y)) {
+		selectables[i].selected = true;
+		colors[i] = highlight_color;
+		current_selection.push_back(manager.handle_of(i));
+	}
 
-		fmt::print("Total mass is {}, charge is {}, and avg scalar momentum {}\n", total_mass, total_charge, total_scalar_momentum / current_selection.size());
+	auto const totals = snapshot.grid.summarize_box(start_pos.x, start_pos.y, end_pos.x, end_pos.y);
 
-	});
-	get_statistics.detach();
+	fmt::print("Selected {} particles\n", totals.count);
+	if (totals.count != 0)
+		fmt::print("Total mass is {}, charge is {}, and avg scalar momentum {}\n", totals.mass, totals.charge, totals.scalar_momentum / totals.count);
 }
 
 
 bool point_particle_simulator::clear_current_selection() {
 	std::unique_lock l(selection_lock, std::try_to_lock);
 	if (l.owns_lock()) {
-		for (auto* p : current_selection) {
-			auto& sel = *p->get_component<Selectable>();
-			auto& gfx_cmp = *p->get_component<GraphicComponent>();
-			auto cur_color = gfx_cmp.getFillColor();
-			auto hl_color = sel.highlight_color;
-			std::swap(cur_color, hl_color);
-			gfx_cmp.setFillColor(cur_color);
-			sel.highlight_color = hl_color;
-			sel.selected = false;
+		auto& manager = physics.manager;
+		for (auto p : current_selection) {
+			manager.get_component<Selectable>(p).selected = false;
+			colors[manager.index_of(p)] = base_color(manager.get_component<Charge>(p));
 		}
 		current_selection.clear();
 		return true;
@@ -104,232 +66,94 @@ bool point_particle_simulator::clear_current_selection() {
 }
 
 
-void point_particle_simulator::sort_pairs() {
-	fmt::print("Begin sort\n");
-	std::sort(distinct_pairs.begin(), distinct_pairs.end(), compare_by_distance);
-	fmt::print("End sort\n");
-}
-
-void point_particle_simulator::generate_pairs() {
-	distinct_pairs.clear();
-
-	auto& particles = manager.get_storage_for_entities();
-
-	distinct_pairs.reserve(particles.size() * particles.size());
-	for (auto first = particles.begin(); first != particles.end(); ++first) {
-		for (auto second = first + 1; second != particles.end(); ++second) {
-			distinct_pairs.push_back(std::make_pair(first->get(), second->get()));
-		}
-	}
+void point_particle_simulator::set_force_solver(force_solver new_solver) noexcept {
+	physics.set_force_solver(new_solver);
 }
 
-std::thread point_particle_simulator::interact_in_separate_thread() {
-	return std::thread([this]() mutable -> void {this->physical_interaction(); });
+void point_particle_simulator::set_opening_angle(float theta) noexcept {
+	physics.set_opening_angle(theta);
 }
 
-void point_particle_simulator::physical_interaction() {
-	std::unique_lock l(interaction_lock, std::try_to_lock);
+void point_particle_simulator::draw() {
+	std::unique_lock l(draw_lock, std::try_to_lock);
 
 	if (!l.owns_lock())
 		return;
 
-	constexpr float wiggle_factor = 1.f;
-
-	auto const perform = [](auto& pair) {
-		auto& [container, callable] = pair;
-		std::for_each(std::execution::par, container.begin(), container.end(), callable);
-	};
-
-	auto const clear_it = [](std::unique_ptr<point_particle>& p) {
-		auto& nc = *p->get_value<PhysicalComponent>();
-		auto& force_vector = *(nc.shared_force);
-
-		for (auto& val : force_vector)
-			val = 0;
-		for (auto& val : nc.acceleration)
-			val = 0;
-	};
-
-
-	auto const wiggle = [this](std::unique_ptr<point_particle>& owning_ptr) {
-		auto& p = *owning_ptr;
-
-		auto& nc = *p.get_value<NewtonianBody>();
-		auto& shape = *p.get_value<sf::CircleShape>();
-
-		/*
-		nc.x += wiggle_factor * this->gen_random_float();
-		nc.y += wiggle_factor * this->gen_random_float();
-		nc.dx_dt += wiggle_factor * this->gen_random_float();
-		nc.dy_dt += wiggle_factor * this->gen_random_float();
-		*/
-	};
-
-	auto const interaction = [](std::pair<point_particle*, point_particle*>& pair) {
-		std::apply(mass_interaction, pair);
-		std::apply(electrical_interaction, pair);
-	};
-
-	auto const move_it = [](std::unique_ptr<point_particle>& owning_ptr) {
-		auto& p = *owning_ptr;
-		auto& nc = *p.get_value<NewtonianBody>();
-		auto& shape = *p.get_value<sf::CircleShape>();
-
-		auto const m = nc.mass;
-
-		mathematics::vector<float, 2> total_force;
-		for(auto i = 0; i < 2; ++i)
-			total_force[i] = (*nc.shared_force)[i];
-
-		nc.acceleration += (1/m) * total_force;
-		nc.velocity += (dt * 0.5f) * nc.acceleration;
-		nc.position += dt * nc.velocity;
-
-		shape.setPosition(nc.position[0], nc.position[1]);
-	};
-
-	auto& particles = manager.get_storage_for_entities();
+	// Never waits for the simulation thread, just takes the newest step it
+	// has finished.
+	auto const& snapshot = runner.latest();
+
+	auto const count = std::min(colors.size(), snapshot.x.size());
+	if (particle_vertices.getVertexCount() != vertices_per_particle * count)
+		particle_vertices.resize(vertices_per_particle * count);
+
+	// Two triangles per particle, a square of side twice the display size
+	// centered on it. Each particle writes only its own six vertices.
+	index_range const everyone(count);
+	std::for_each(std::execution::par, everyone.begin(), everyone.end(), [this, &snapshot](size_t i) {
+		constexpr float r = particle_display_size;
+		auto const x = snapshot.x[i];
+		auto const y = snapshot.y[i];
+		auto const color = colors[i];
+
+		sf::Vector2f const corners[vertices_per_particle] = {
+			{ x - r, y - r }, { x + r, y - r }, { x + r, y + r },
+			{ x - r, y - r }, { x + r, y + r }, { x - r, y + r }
+		};
 
-	auto const linear_interaction = [&](auto&) mutable {
-		auto& list = manager.get_storage_for_entities();
-		size_t cycles = 0;
-		for (auto entity_itr = list.begin(); entity_itr != list.end(); ++entity_itr) {
-			for (auto entity_itr2 = entity_itr + 1; entity_itr2 != list.end(); ++entity_itr2) {
-				++cycles;
-				std::pair<point_particle*, point_particle*> a = std::make_pair(entity_itr->get(), entity_itr2->get());
-				interaction(a);
-			}
+		auto* const v = &particle_vertices[vertices_per_particle * i];
+		for (size_t c = 0; c < vertices_per_particle; ++c) {
+			v[c].position = corners[c];
+			v[c].color = color;
 		}
-		fmt::print("linear_interaction took {} cycles\n", cycles);
-	};
-
-
-	//std::vector<int> dummy(1, 0);
-
-	auto const pairs = std::make_tuple(
-		std::make_pair(std::reference_wrapper(particles), clear_it),
-		//std::make_pair(std::reference_wrapper(particles), wiggle),
-		//std::make_pair(std::reference_wrapper(dummy), linear_interaction),
-		std::make_pair(std::reference_wrapper(distinct_pairs), interaction),
-		std::make_pair(std::reference_wrapper(particles), move_it));
-
-	auto const perform_each_arg = [perform](auto const & ... pair) {(..., perform(pair)); };
-	// Using ... first gets correct expansion order
-
-	std::apply(perform_each_arg, pairs);
-
-}
-
-void point_particle_simulator::draw() {
-	std::unique_lock l(draw_lock, std::try_to_lock);
-
-	if (!l.owns_lock())
-		return;
+	});
 
-	auto& gc = manager.get_storage_for_component<GraphicComponent>();
-	draw_function(gc);
+	draw_function();
 }
 
 void point_particle_simulator::spawn_particles() {
+	physics.spawn_particles();
+	reset_colors();
+}
 
-
-	for (size_t i = 0; i < num_dots; ++i) {
-		sf::CircleShape particle(particle_display_size);
-
-		float const theta = static_cast<float>(std::numbers::pi) * delta_dist(mt);
-		float const r = delta_dist(mt);
-
-		float const mass = 1836.f;
-		float const charge = 1.f;
-
-		float const x = width / 2 + placement_scale_factor * r * cos(theta) * smaller_dimension / 3;
-		float const y = height / 2 + placement_scale_factor * r * sin(theta) * smaller_dimension / 3;
-
-		particle.setPosition(x, y);
-
-
-		if (charge == 1.f)
-			particle.setFillColor(sf::Color::Red);
-		else if (charge == -1.f)
-			particle.setFillColor(sf::Color::Blue);
-		else if (charge == 0.f)
-			particle.setFillColor(sf::Color(200, 200, 200));
-		else
-			particle.setFillColor(sf::Color::Yellow);
-
-		manager.push_back(std::make_unique<point_particle>(PhysicalComponent(x, y, mass), ElectricalComponent(charge), Selectable(), std::move(particle)));
-	}
-
-	for (size_t i = 0; i < num_dots * 3; ++i) {
-		sf::CircleShape particle(particle_display_size);
-
-		float const theta = static_cast<float>(std::numbers::pi) * delta_dist(mt);
-		float const r = delta_dist(mt);
-
-		float const mass = 1837.f;
-		float const charge = 0.f;
-
-		float const x = width / 2 + placement_scale_factor * (1 - std::copysignf(r, r)) * cos(theta) * smaller_dimension / 4;
-		float const y = height / 2 + placement_scale_factor * (1 - std::copysignf(r, r)) * sin(theta) * smaller_dimension / 4;
-
-		particle.setPosition(x, y);
-
-		if (charge == 1.f)
-			particle.setFillColor(sf::Color::Red);
-		else if (charge == -1.f)
-			particle.setFillColor(sf::Color::Blue);
-		else if (charge == 0.f)
-			particle.setFillColor(sf::Color(150, 150, 150));
-		else
-			particle.setFillColor(sf::Color::Yellow);
-
-		auto p = std::make_unique<point_particle>(PhysicalComponent(x, y, mass), ElectricalComponent(charge), Selectable(), std::move(particle));
-
-		manager.push_back(std::move(p));
+bool point_particle_simulator::load_checkpoint(std::string const& path) {
+	mapped_checkpoint checkpoint;
+	if (!checkpoint.open(path)) {
+		fmt::print(stderr, "Could not load checkpoint: {}\n", checkpoint.error());
+		return false;
 	}
 
+	restore_checkpoint(physics, checkpoint);
+	reset_colors();
+	fmt::print("Loaded step {} from {}\n", physics.get_step_count(), path);
+	return true;
+}
 
-	for (size_t i = 0; i < num_dots; ++i) {
-		sf::CircleShape particle(particle_display_size);
-
-		float const theta = static_cast<float>(std::numbers::pi) * delta_dist(mt);
-		float const raw_r = delta_dist(mt);
-		float const r = std::copysignf(std::powf(raw_r, 2.f), raw_r);
-
-		float const mass = 1.f;
-		float const charge = -1.f;
-
-		float const x = width / 2 + placement_scale_factor * (1 - std::copysignf(r * r, r)) * cos(theta) * smaller_dimension;
-		float const y = height / 2 + placement_scale_factor * (1 - std::copysignf(r * r, r)) * sin(theta) * smaller_dimension;
-
-		particle.setPosition(x, y);
-
-		if (charge == 1.f)
-			particle.setFillColor(sf::Color::Red);
-		else if (charge == -1.f)
-			particle.setFillColor(sf::Color::Blue);
-		else if (charge == 0.f)
-			particle.setFillColor(sf::Color(200, 200, 200));
-		else
-			particle.setFillColor(sf::Color::Yellow);
+void point_particle_simulator::reset_colors() {
+	auto const charges = physics.manager.get_storage_for_component<Charge>();
 
-		manager.push_back(std::make_unique<point_particle>(PhysicalComponent(x, y, mass), charge, Selectable(), std::move(particle)));
-	}
+	colors.clear();
+	for (auto const q : charges)
+		colors.push_back(base_color(q));
 }
 
-float point_particle_simulator::gen_random_float() {
-	return delta_dist(mt);
+sf::Color point_particle_simulator::base_color(float charge) {
+	if (charge == 1.f)
+		return sf::Color::Red;
+	else if (charge == -1.f)
+		return sf::Color::Blue;
+	else if (charge == 0.f)
+		return sf::Color(150, 150, 150);
+	return sf::Color::Yellow;
 }
 
-void point_particle_simulator::draw_function(std::vector<GraphicComponent*>& graphical_representations) {
+void point_particle_simulator::draw_function() {
 
 		window.clear();
 
-		auto draw_a_single_component = [this](auto* gc) {
-			this->window.draw(*gc);
-		};
-
-		std::for_each(std::execution::seq, graphical_representations.begin(), graphical_representations.end(), draw_a_single_component);
+		// Every particle in one draw call.
+		window.draw(particle_vertices);
 
 
 		sf::Text txt;
@@ -362,17 +186,14 @@ void point_particle_simulator::run() {
 	auto end_pos_left = start_pos_right;
 
 
-	bool run = false;
-
-	//size_t cycle_count = 0;
+	// One step per frame at the old frame rate, but no longer in lockstep.
+	runner.set_step_rate_limit(60.f);
+	runner.start();
 
 	while (window.isOpen())
 	{
 		auto const tick = clock.now();
 
-		if (run)
-			physical_interaction();
-
 		sf::Event event;
 		while (window.pollEvent(event))
 		{
@@ -381,7 +202,42 @@ void point_particle_simulator::run() {
 				window.close();
 			else if (event.type == sf::Event::KeyPressed) {
 				if (event.key.code == sf::Keyboard::Space) {
-					run = !run;
+					runner.set_paused(!runner.paused());
+				}
+				else if (event.key.code == sf::Keyboard::P) {
+					auto& profiler = physics.get_profiler();
+					profiler.set_enabled(!profiler.enabled());
+					if (profiler.enabled())
+						fmt::print("Profiling steps\n");
+					else
+						profiler.print_summary();
+				}
+				else if (event.key.code == sf::Keyboard::B) {
+					auto const solver = static_cast<force_solver>((static_cast<int>(physics.get_force_solver()) + 1) % (static_cast<int>(force_solver::short_range) + 1));
+					physics.set_force_solver(solver);
+					fmt::print("Using {} force solver\n", force_solver_name(solver));
+				}
+				else if (event.key.code == sf::Keyboard::D) {
+					physics.set_deterministic(!physics.is_deterministic());
+					fmt::print("Deterministic stepping {}\n", physics.is_deterministic() ? "on" : "off");
+				}
+				else if (event.key.code == sf::Keyboard::T) {
+					auto const levels = (physics.get_timestep_levels() + 1) % 5;
+					physics.set_timestep_levels(levels);
+					fmt::print("Timestep levels: {}\n", levels);
+				}
+				else if (event.key.code == sf::Keyboard::R) {
+					auto const steps = physics.get_inner_steps() >= 8 ? 1 : 2 * physics.get_inner_steps();
+					physics.set_inner_steps(steps);
+					fmt::print("Near field inner steps: {}\n", steps);
+				}
+				else if (event.key.code == sf::Keyboard::I) {
+					auto const which = static_cast<integrator>((static_cast<int>(physics.get_integrator()) + 1) % (static_cast<int>(integrator::forest_ruth) + 1));
+					physics.set_integrator(which);
+					fmt::print("Using {} integrator\n", integrator_name(which));
+				}
+				else if (event.key.code == sf::Keyboard::S) {
+					runner.request_checkpoint("checkpoint.bin");
 				}
 			}
 			else if (event.type == sf::Event::MouseWheelScrolled) {
@@ -1,4 +1,8 @@
-#include "point_particle.hpp"
+#pragma once
+
+#include "index_range.hpp"
+#include "simulation.hpp"
+#include "simulation_runner.hpp"
 
 #include <cmath>
 
@@ -8,13 +12,14 @@
 #include <iostream>
 #include <optional>
 #include <random>
+#include <string>
 #include <vector>
 
 #include <fmt/format.h>
 
-#include <SFML\Graphics.hpp>
-#include <SFML\Main.hpp>
-#include <SFML\Window.hpp>
+#include <SFML/Graphics.hpp>
+#include <SFML/Main.hpp>
+#include <SFML/Window.hpp>
 
 class point_particle_simulator {
 public:
@@ -25,55 +30,59 @@ public:
 	bool clear_current_selection();
 
 	void reserve(size_t desired_capacity) {
-		manager.reserve(desired_capacity);
+		physics.reserve(desired_capacity);
+		colors.reserve(desired_capacity);
 	}
 
-	void generate_pairs();
-
-	std::thread interact_in_separate_thread();
+	void set_force_solver(force_solver new_solver) noexcept;
 
-	void sort_pairs();
+	void set_opening_angle(float theta) noexcept;
 
 	void draw();
 
 	void spawn_particles();
 
+	// Replaces the particles with the ones saved in a checkpoint. Returns
+	// false if the file could not be read.
+	bool load_checkpoint(std::string const& path);
+
 	void run();
 
-	EntityManagerType manager;
+	simulation physics;
 private:
 
-	void physical_interaction();
-
-	float gen_random_float();
+	void draw_function();
+	void reset_colors();
 
-	void draw_function(std::vector<GraphicComponent*>& graphical_representations);
+	static sf::Color base_color(float charge);
 
+	static constexpr size_t width = simulation::width;
+	static constexpr size_t height = simulation::height;
 
-	static constexpr size_t width = 1280;
-	static constexpr size_t height = 720;
-	static constexpr size_t smaller_dimension = std::min(width, height);
-
-	static constexpr size_t num_dots = 1500;
 	static constexpr float particle_display_size = 5.f;
-	static constexpr float placement_scale_factor = 1.f;
+	static constexpr size_t vertices_per_particle = 6;
+	static inline sf::Color const highlight_color = sf::Color::Yellow;
 
-	std::random_device rd;
-	std::mt19937 mt;
-	std::uniform_real_distribution<float> delta_dist;
 	std::chrono::high_resolution_clock clock;
 
 
 	sf::RenderWindow window;
 	sf::View v;
+	sf::VertexArray particle_vertices;
 	sf::Font font;
 
 	float approx_fps;
 	float zoom_factor;
 
-	std::vector<std::pair<point_particle*, point_particle*>> distinct_pairs;
-	std::vector<point_particle*> current_selection;
-	std::mutex interaction_lock;
+	// Steps physics on its own thread. Declared after physics so it is
+	// stopped before physics goes away.
+	simulation_runner runner;
+
+	// One color per particle, in the same dense order as the columns. Only
+	// selection changes them, the vertices are rebuilt from these each frame.
+	std::vector<sf::Color> colors;
+
+	std::vector<point_particle> current_selection;
 	std::mutex selection_lock;
 	std::mutex draw_lock;
 };
\ No newline at end of file
@@ -0,0 +1,761 @@
+#include "simulation.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numbers>
+#include <numeric>
+#include <tuple>
+
+#include "force_laws.hpp"
+#include "index_range.hpp"
+#include "pair_tiles.hpp"
+
+namespace {
+
+	// Runs f with species_pair_force when the species are known, whose
+	// couplings already leave the charge out of neutral pairs. Otherwise
+	// with neutral_pair_force if every pair f sums has a neutral particle
+	// in it, else with pair_force.
+	template<typename Function>
+	void with_pair_laws(particle_arrays const& particles, bool neutral, Function&& f) {
+		if (particles.species)
+			f.template operator()<species_pair_force>();
+		else if (neutral)
+			f.template operator()<neutral_pair_force>();
+		else
+			f.template operator()<pair_force>();
+	}
+
+	// Whether every pair of a tile has a neutral particle in it. Tiles are
+	// above the diagonal, so their columns start no earlier than their rows.
+	bool neutral_tile(particle_arrays const& particles, pair_tiles::tile const& t) noexcept {
+		return t.column_begin >= particles.charged_count();
+	}
+
+}
+
+simulation::simulation()
+	: mt(rd()),
+	delta_dist(-1.0, 1.0),
+	step_count(0),
+	elapsed_time(0.0),
+	solver(force_solver::direct_sum),
+	opening_angle(tree.get_opening_angle()),
+	mesh_cells(particle_mesh::settings{}.cells),
+	assignment(particle_mesh::settings{}.assignment),
+	mesh_split(particle_mesh::settings{}.split),
+	multipole_order(fast_multipole::settings{}.order),
+	multipole_separation(fast_multipole::settings{}.separation),
+	integration(integrator::leapfrog),
+	timestep(dt),
+	deterministic(false),
+	timestep_levels(0),
+	inner_steps(1),
+	near_start(default_near_start),
+	near_cutoff(default_near_cutoff),
+	near_skin(default_near_skin),
+	accelerations_current(false),
+	split_current(false),
+	pool(std::make_unique<thread_pool>()),
+	thread_count(pool->size()),
+	vector_kernel(get_direct_sum_kernel(best_simd_level())),
+	forces(pool->size()) {
+}
+
+char const* force_solver_name(force_solver solver) noexcept {
+	switch (solver) {
+	case force_solver::vectorized_direct_sum:
+		return "vectorized direct sum";
+	case force_solver::barnes_hut:
+		return "Barnes-Hut";
+	case force_solver::particle_mesh:
+		return "particle-mesh";
+	case force_solver::fast_multipole:
+		return "fast multipole";
+	case force_solver::short_range:
+		return "short range";
+	default:
+		return "direct sum";
+	}
+}
+
+void simulation::set_force_solver(force_solver new_solver) noexcept {
+	solver.store(new_solver, std::memory_order_relaxed);
+}
+
+void simulation::set_opening_angle(float theta) noexcept {
+	opening_angle.store(theta, std::memory_order_relaxed);
+}
+
+void simulation::set_mesh(particle_mesh::settings const& settings) noexcept {
+	mesh_cells.store(settings.cells, std::memory_order_relaxed);
+	assignment.store(settings.assignment, std::memory_order_relaxed);
+	mesh_split.store(settings.split, std::memory_order_relaxed);
+}
+
+particle_mesh::settings simulation::get_mesh() const noexcept {
+	return { mesh_cells.load(std::memory_order_relaxed), assignment.load(std::memory_order_relaxed), mesh_split.load(std::memory_order_relaxed) };
+}
+
+void simulation::set_multipole(fast_multipole::settings const& settings) noexcept {
+	multipole_order.store(settings.order, std::memory_order_relaxed);
+	multipole_separation.store(settings.separation, std::memory_order_relaxed);
+}
+
+fast_multipole::settings simulation::get_multipole() const noexcept {
+	return { multipole_order.load(std::memory_order_relaxed), multipole_separation.load(std::memory_order_relaxed) };
+}
+
+force_solver simulation::get_force_solver() const noexcept {
+	return solver.load(std::memory_order_relaxed);
+}
+
+void simulation::set_threads(thread_pool::options const& settings) {
+	std::lock_guard l(interaction_lock);
+	pool = std::make_unique<thread_pool>(settings);
+	thread_count.store(pool->size(), std::memory_order_relaxed);
+
+	// A slot per thread that can hold one, so none waits for a slot and
+	// take() sums no more than it has to.
+	forces = force_accumulator(pool->size());
+}
+
+unsigned simulation::get_threads() const noexcept {
+	return thread_count.load(std::memory_order_relaxed);
+}
+
+void simulation::set_integrator(integrator which) noexcept {
+	integration.store(which, std::memory_order_relaxed);
+}
+
+integrator simulation::get_integrator() const noexcept {
+	return integration.load(std::memory_order_relaxed);
+}
+
+void simulation::set_timestep(float step) noexcept {
+	if (step > 0.f)
+		timestep.store(step, std::memory_order_relaxed);
+}
+
+float simulation::get_timestep() const noexcept {
+	return timestep.load(std::memory_order_relaxed);
+}
+
+void simulation::set_deterministic(bool on) noexcept {
+	deterministic.store(on, std::memory_order_relaxed);
+}
+
+bool simulation::is_deterministic() const noexcept {
+	return deterministic.load(std::memory_order_relaxed);
+}
+
+void simulation::set_timestep_levels(unsigned levels) noexcept {
+	timestep_levels.store(std::min(levels, block_timesteps::max_supported_level), std::memory_order_relaxed);
+}
+
+unsigned simulation::get_timestep_levels() const noexcept {
+	return timestep_levels.load(std::memory_order_relaxed);
+}
+
+void simulation::set_inner_steps(unsigned steps) noexcept {
+	inner_steps.store(std::max(1u, steps), std::memory_order_relaxed);
+}
+
+unsigned simulation::get_inner_steps() const noexcept {
+	return inner_steps.load(std::memory_order_relaxed);
+}
+
+void simulation::set_near_field(float switch_start, float cutoff) noexcept {
+	near_start.store(std::max(0.f, std::min(switch_start, cutoff)), std::memory_order_relaxed);
+	near_cutoff.store(std::max(0.f, cutoff), std::memory_order_relaxed);
+}
+
+void simulation::set_near_skin(float skin) noexcept {
+	near_skin.store(std::max(0.f, skin), std::memory_order_relaxed);
+}
+
+void simulation::particles_replaced() noexcept {
+	accelerations_current = false;
+	split_current = false;
+	near.invalidate();
+	short_range_neighbours.invalidate();
+}
+
+std::span<uint32_t const> simulation::all_particles(size_t count) {
+	if (all_indices.size() != count) {
+		all_indices.resize(count);
+		std::iota(all_indices.begin(), all_indices.end(), uint32_t(0));
+	}
+	return all_indices;
+}
+
+std::vector<size_t> indices_in_box(std::span<float const> x, std::span<float const> y, float x0, float y0, float x1, float y1) {
+	auto const lx = std::min(x0, x1);
+	auto const bx = std::max(x0, x1);
+	auto const ly = std::min(y0, y1);
+	auto const by = std::max(y0, y1);
+
+	std::vector<size_t> hits;
+	for (size_t i = 0; i < x.size(); ++i) {
+		if (lx <= x[i] and x[i] <= bx and ly <= y[i] and y[i] <= by)
+			hits.push_back(i);
+	}
+
+	return hits;
+}
+
+std::vector<point_particle> simulation::particles_in_box(float x0, float y0, float x1, float y1) const {
+	auto const x = manager.get_storage_for_component<PositionX>();
+	auto const y = manager.get_storage_for_component<PositionY>();
+
+	std::vector<point_particle> hits;
+	for (auto const i : indices_in_box(x, y, x0, y0, x1, y1))
+		hits.push_back(manager.handle_of(i));
+
+	return hits;
+}
+
+void simulation::step() {
+	std::unique_lock l(interaction_lock, std::try_to_lock);
+
+	if (!l.owns_lock())
+		return;
+
+	auto const particles = get_particle_arrays(manager, species_registry);
+	auto const solver = this->solver.load(std::memory_order_relaxed);
+	auto const levels = timestep_levels.load(std::memory_order_relaxed);
+	auto const inner = levels > 0 ? 1u : inner_steps.load(std::memory_order_relaxed);
+	auto const h = timestep.load(std::memory_order_relaxed);
+
+	profiler.begin_step();
+
+	if (levels > 0) {
+		step_blocks(particles, solver, levels, h);
+	}
+	else {
+		integrators::dispatch(integration.load(std::memory_order_relaxed), [&]<typename Integrator>() {
+			if (inner > 1)
+				step_respa<Integrator>(particles, solver, inner, h);
+			else
+				step_with<Integrator>(particles, solver, h);
+		});
+	}
+
+	// Only split steps keep the near and far parts up to date.
+	if (inner == 1)
+		split_current = false;
+
+	++step_count;
+	elapsed_time += h;
+	profiler.end_step(particles.size);
+}
+
+template<typename Integrator>
+void simulation::step_with(particle_arrays const& particles, force_solver solver, float h) {
+	// Kicks and drifts are only queued here. They run with the next force
+	// evaluation, or at the end of the step, where the scheduler fuses the
+	// ones in a row into a single sweep over the particles.
+	integrators::ops ops{
+		[&](float c) {
+			pending.push_back(particle_systems::each_entity(reads<AccelerationX, AccelerationY>{}, writes<VelocityX, VelocityY>{}, [particles, c](size_t i) {
+				particles.vx[i] += c * particles.ax[i];
+				particles.vy[i] += c * particles.ay[i];
+			}));
+		},
+		[&](float c) {
+			pending.push_back(particle_systems::each_entity(reads<VelocityX, VelocityY>{}, writes<PositionX, PositionY>{}, [particles, c](size_t i) {
+				particles.x[i] += c * particles.vx[i];
+				particles.y[i] += c * particles.vy[i];
+			}));
+		},
+		[&](float c) {
+			pending.push_back(particle_systems::each_entity(reads<VelocityX, VelocityY, AccelerationX, AccelerationY>{}, writes<PositionX, PositionY>{}, [particles, c](size_t i) {
+				particles.x[i] += c * particles.vx[i] + (0.5f * c * c) * particles.ax[i];
+				particles.y[i] += c * particles.vy[i] + (0.5f * c * c) * particles.ay[i];
+			}));
+		},
+		[&] {
+			accelerations_of(particles, solver, all_particles(particles.size));
+		},
+		[&](float c) {
+			accelerations_of(particles, solver, all_particles(particles.size), c);
+		}
+	};
+
+	// Each step ends on a force evaluation at the new positions, which the
+	// next step starts from.
+	if (!accelerations_current)
+		ops.update_forces();
+
+	Integrator::step(ops, h);
+
+	if (!pending.empty()) {
+		auto const timer = profiler.time(step_phase::integrate);
+		run_pending(particles);
+	}
+	accelerations_current = true;
+}
+
+void simulation::slot_tile_forces(particle_arrays const& particles, pair_tiles::tile const& t) {
+	auto slot = forces.acquire();
+
+	with_pair_laws(particles, neutral_tile(particles, t), [&particles, &slot, &t]<typename Interaction>() {
+		t.for_each_pair([&particles, &slot](size_t i, size_t j) {
+			auto const force = Interaction::force(particles, i, j);
+
+			slot[i] += force;
+			slot[j] -= force;
+		});
+	});
+}
+
+void simulation::round_forces(particle_arrays const& particles, pair_tiles const& tiles) {
+	// Tiles in a round never touch the same particle twice, so they add
+	// straight into the force columns. That costs a join per round, which
+	// matters most for small N where a round has few tiles to spread over
+	// the threads.
+	auto const round_interaction = [particles](pair_tiles::tile const& t) {
+		with_pair_laws(particles, neutral_tile(particles, t), [&particles, &t]<typename Interaction>() {
+			for (auto i = t.row_begin; i < t.row_end; ++i) {
+				// Row i's share stays in registers and is added once.
+				force_accumulator::force_t on_i;
+				auto const first_column = t.on_diagonal() ? i + 1 : t.column_begin;
+				for (auto j = first_column; j < t.column_end; ++j) {
+					auto const force = Interaction::force(particles, i, j);
+
+					on_i += force;
+					particles.fx[j] -= force[0];
+					particles.fy[j] -= force[1];
+				}
+				particles.fx[i] += on_i[0];
+				particles.fy[i] += on_i[1];
+			}
+		});
+	};
+
+	for (size_t r = 0; r < tiles.round_count(); ++r) {
+		index_range const round(tiles.round_size(r));
+		pool->for_each(round, [&tiles, r, &round_interaction](size_t k) {
+			round_interaction(tiles.round_tile(r, k));
+		}, 1);
+	}
+}
+
+void simulation::accelerations_of(particle_arrays const& particles, force_solver solver, std::span<uint32_t const> subset, float kick) {
+	auto const timer = profiler.time(step_phase::pair_interaction);
+	auto const everyone = subset.size() == particles.size;
+
+	using body = reads<PositionX, PositionY, Mass, Charge, Species>;
+	using set_components = writes<ForceX, ForceY, AccelerationX, AccelerationY, VelocityX, VelocityY>;
+
+	auto const set_acceleration = [particles, kick](size_t i, float fx, float fy) {
+		particles.fx[i] = fx;
+		particles.fy[i] = fy;
+		particles.ax[i] = fx / particles.mass[i];
+		particles.ay[i] = fy / particles.mass[i];
+		particles.vx[i] += kick * particles.ax[i];
+		particles.vy[i] += kick * particles.ay[i];
+	};
+
+	// a = F / m from the force columns, as a sweep of its own when it is
+	// for everyone.
+	auto const finish_from_forces = [&] {
+		auto const from_forces = [set_acceleration, particles](size_t i) {
+			set_acceleration(i, particles.fx[i], particles.fy[i]);
+		};
+
+		if (everyone)
+			pending.push_back(particle_systems::each_entity(reads<ForceX, ForceY, Mass>{}, set_components{}, from_forces));
+		else
+			pending.push_back(particle_systems::once(reads<ForceX, ForceY, Mass>{}, set_components{}, [this, subset, from_forces] {
+				pool->for_each(subset, from_forces);
+			}));
+	};
+
+	size_t pairs = 0;
+	std::atomic<size_t> tree_interactions = 0;
+	std::vector<size_t> blocks;
+	pair_tiles const tiles(particles.size);
+
+	if (solver == force_solver::vectorized_direct_sum) {
+		// The kernel works on whole blocks, so run it on every block with
+		// someone in the subset. Particles of one species were spawned
+		// together, so the active ones tend to share blocks.
+		constexpr size_t block_size = 64;
+		for (auto const i : subset) {
+			if (blocks.empty() or blocks.back() != i / block_size)
+				blocks.push_back(i / block_size);
+		}
+
+		pending.push_back(particle_systems::once(body{}, writes<ForceX, ForceY>{}, [this, particles, &blocks] {
+			pool->for_each(blocks, [this, particles](size_t b) {
+				auto const first = b * block_size;
+				auto const last = std::min(particles.size, first + block_size);
+				std::fill(particles.fx + first, particles.fx + last, 0.f);
+				std::fill(particles.fy + first, particles.fy + last, 0.f);
+				vector_kernel(particles, first, last);
+			});
+		}));
+		finish_from_forces();
+
+		pairs = blocks.size() * block_size * particles.size;
+	}
+	else if (solver == force_solver::barnes_hut) {
+		// The tree is not a component, so building and walking it stay in
+		// one system to keep them in order.
+		pending.push_back(particle_systems::once(body{}, set_components{}, [this, particles, subset, &set_acceleration, &tree_interactions] {
+			{
+				auto const build_timer = profiler.time(step_phase::build_tree);
+				tree.set_opening_angle(opening_angle.load(std::memory_order_relaxed));
+				tree.build(particles);
+			}
+
+			pool->for_each(subset, [this, &set_acceleration, &tree_interactions](size_t i) {
+				size_t interactions = 0;
+				auto const force = tree.force_on(i, profiler.recording() ? &interactions : nullptr);
+				if (interactions != 0)
+					tree_interactions.fetch_add(interactions, std::memory_order_relaxed);
+				set_acceleration(i, force[0], force[1]);
+			});
+		}));
+	}
+	else if (solver == force_solver::particle_mesh) {
+		// Like the tree, the mesh is not a component.
+		pending.push_back(particle_systems::once(body{}, set_components{}, [this, particles, subset, &set_acceleration, &tree_interactions] {
+			{
+				auto const build_timer = profiler.time(step_phase::build_tree);
+				mesh.build(*pool, particles, get_mesh());
+			}
+
+			pool->for_each(subset, [this, &set_acceleration, &tree_interactions](size_t i) {
+				size_t interactions = 0;
+				auto const force = mesh.force_on(i, profiler.recording() ? &interactions : nullptr);
+				if (interactions != 0)
+					tree_interactions.fetch_add(interactions, std::memory_order_relaxed);
+				set_acceleration(i, force[0], force[1]);
+			});
+		}));
+	}
+	else if (solver == force_solver::fast_multipole) {
+		pending.push_back(particle_systems::once(body{}, set_components{}, [this, particles, subset, &set_acceleration, &tree_interactions] {
+			{
+				auto const build_timer = profiler.time(step_phase::build_tree);
+				multipole.build(*pool, particles, get_multipole());
+			}
+
+			pool->for_each(subset, [this, &set_acceleration, &tree_interactions](size_t i) {
+				size_t interactions = 0;
+				auto const force = multipole.force_on(i, profiler.recording() ? &interactions : nullptr);
+				if (interactions != 0)
+					tree_interactions.fetch_add(interactions, std::memory_order_relaxed);
+				set_acceleration(i, force[0], force[1]);
+			});
+		}));
+	}
+	else if (solver == force_solver::short_range) {
+		// Nor are the neighbour lists. If every short-range law needs
+		// charge, the neutral particles feel nothing and skip the walk.
+		pending.push_back(particle_systems::once(body{}, set_components{}, [this, particles, subset, &set_acceleration, &tree_interactions] {
+			{
+				auto const build_timer = profiler.time(step_phase::build_tree);
+				short_range_neighbours.update(*pool, particles, { short_range_pair_force::cutoff(), near_skin.load(std::memory_order_relaxed) });
+			}
+
+			pool->for_each(subset, [this, particles, &set_acceleration, &tree_interactions](size_t i) {
+				constexpr bool charged_only = std::is_same_v<neutral_laws_of<registered_short_range_laws>::type, ListsViaTypes::TypeList<>>;
+				force_accumulator::force_t total;
+				if (!charged_only or i < particles.charged_count()) {
+					size_t found = 0;
+					short_range_neighbours.for_each_neighbour(i, [&](size_t j) {
+						++found;
+						total += short_range_pair_force::force(particles, i, j);
+					});
+					tree_interactions.fetch_add(found, std::memory_order_relaxed);
+				}
+				set_acceleration(i, total[0], total[1]);
+			});
+		}));
+	}
+	else if (everyone) {
+		// Every particle at once, which is every ordinary step, gets the
+		// third law through tile passes. Tiles are just index ranges over
+		// the columns, so they are cheap enough to describe from scratch.
+		if (deterministic.load(std::memory_order_relaxed)) {
+			// The pair slots make each particle's sum depend on which tiles
+			// shared a slot, so round_forces runs the tiles in rounds that
+			// add straight into the force columns instead.
+			pending.push_back(particle_systems::each_entity(reads<>{}, writes<ForceX, ForceY>{}, [particles](size_t i) {
+				particles.fx[i] = 0.f;
+				particles.fy[i] = 0.f;
+			}));
+			pending.push_back(particle_systems::once(body{}, writes<ForceX, ForceY>{}, [this, particles, &tiles] {
+				round_forces(particles, tiles);
+			}));
+			finish_from_forces();
+		}
+		else {
+			// A block of particles is done once the tiles in its row and
+			// column are, so each block sums its slots (and kicks) while the
+			// other tiles are still running instead of waiting for all of
+			// them.
+			auto const tile_size = tiles.get_tile_size();
+			auto const tile_rows = (particles.size + tile_size - 1) / tile_size;
+			forces.resize(particles.size);
+			force_graph.clear();
+
+			std::vector<task_graph::node> finish(tile_rows);
+			for (size_t b = 0; b < tile_rows; ++b) {
+				auto const first = b * tile_size;
+				auto const count = std::min(particles.size, first + tile_size) - first;
+				finish[b] = force_graph.add(count, [this, &set_acceleration, first](size_t k) {
+					auto const slot_force = forces.take(first + k);
+					set_acceleration(first + k, slot_force[0], slot_force[1]);
+				}, 64);
+			}
+
+			for (size_t t = 0; t < tiles.size(); ++t) {
+				auto const tile = tiles[t];
+				auto const pass = force_graph.add(1, [this, &particles, tile](size_t) {
+					slot_tile_forces(particles, tile);
+				});
+				force_graph.precede(pass, finish[tile.row_begin / tile_size]);
+				if (!tile.on_diagonal())
+					force_graph.precede(pass, finish[tile.column_begin / tile_size]);
+			}
+
+			pending.push_back(particle_systems::once(body{}, set_components{}, [this] {
+				pool->run(force_graph);
+				forces.end_pass();
+			}));
+		}
+
+		pairs = tiles.pair_count();
+	}
+	else {
+		// Whole rows in a fixed order, so this is deterministic as it is.
+		pending.push_back(particle_systems::once(body{}, set_components{}, [this, particles, subset, &set_acceleration] {
+			pool->for_each(subset, [&set_acceleration, particles](size_t i) {
+				// Charged rows see the charged particles with every law and
+				// the rest, like neutral rows see everyone, without those
+				// needing charge.
+				auto const charged = i < particles.charged_count() ? particles.charged_count() : 0;
+				force_accumulator::force_t total;
+				auto const sum_over = [&](size_t first, size_t last, bool neutral) {
+					with_pair_laws(particles, neutral, [&]<typename Interaction>() {
+						for (auto j = first; j < last; ++j) {
+							if (j != i)
+								total += Interaction::force(particles, i, j);
+						}
+					});
+				};
+				sum_over(0, charged, false);
+				sum_over(charged, particles.size, true);
+				set_acceleration(i, total[0], total[1]);
+			});
+		}));
+
+		pairs = subset.size() * (particles.size - 1);
+	}
+
+	// Any kicks and drifts the integrator deferred go first, fused with the
+	// sweeps above where they are next to each other.
+	run_pending(particles);
+
+	profiler.add_pairs(pairs + tree_interactions.load());
+}
+
+void simulation::run_pending(particle_arrays const& particles) {
+	systems.run(*pool, particles.size, pending);
+	pending.clear();
+}
+
+void simulation::step_blocks(particle_arrays const& particles, force_solver solver, unsigned levels, float h) {
+	index_range const everyone(particles.size);
+
+	if (!accelerations_current or timesteps.size() != particles.size)
+		accelerations_of(particles, solver, all_particles(particles.size));
+
+	auto const integrate_timer = [this] { return profiler.time(step_phase::integrate); };
+
+	{
+		auto const timer = integrate_timer();
+		block_timesteps::settings settings;
+		settings.max_level = levels;
+		settings.step = h;
+		timesteps.begin(*pool, particles, settings);
+
+		pool->for_each(everyone, [this, particles](size_t i) {
+			auto const half = 0.5f * timesteps.step_of(i);
+			particles.vx[i] += half * particles.ax[i];
+			particles.vy[i] += half * particles.ay[i];
+		});
+	}
+
+	auto const end = timesteps.ticks_per_step();
+	for (uint32_t now = 0; now < end;) {
+		std::span<uint32_t const> active;
+		{
+			auto const timer = integrate_timer();
+			auto const next = timesteps.next_event();
+			auto const h = static_cast<float>(next - now) * timesteps.tick();
+
+			// Everyone drifts, inactive particles included, so the forces
+			// on the active ones see positions at the same time.
+			pool->for_each(everyone, [particles, h](size_t i) {
+				particles.x[i] += h * particles.vx[i];
+				particles.y[i] += h * particles.vy[i];
+			});
+
+			now = next;
+			active = timesteps.collect_active(now);
+		}
+
+		accelerations_of(particles, solver, active);
+
+		auto const timer = integrate_timer();
+		pool->for_each(active, [this, particles, now, end](size_t i) {
+			// Closing half kick of the step that just ended, then the
+			// opening one of the next, which may be shorter.
+			auto kick = 0.5f * timesteps.step_of(i);
+			if (now < end) {
+				timesteps.reschedule(i, now, particles.ax[i], particles.ay[i]);
+				kick += 0.5f * timesteps.step_of(i);
+			}
+			particles.vx[i] += kick * particles.ax[i];
+			particles.vy[i] += kick * particles.ay[i];
+		});
+	}
+
+	accelerations_current = true;
+}
+
+template<typename Integrator>
+void simulation::step_respa(particle_arrays const& particles, force_solver solver, unsigned inner, float h) {
+	index_range const everyone(particles.size);
+	smooth_switch const split{ near_start.load(std::memory_order_relaxed), near_cutoff.load(std::memory_order_relaxed) };
+
+	auto const near_accelerations = [&] {
+		auto const timer = profiler.time(step_phase::pair_interaction);
+		near.accelerations(*pool, particles, split, near_skin.load(std::memory_order_relaxed), near_ax, near_ay);
+		profiler.add_pairs(near.pairs_visited());
+	};
+
+	// The far part is whatever the solver gives minus the near part, so
+	// any solver can supply it and the near part is always exact.
+	auto const far_accelerations = [&] {
+		accelerations_of(particles, solver, all_particles(particles.size));
+		far_ax.resize(particles.size);
+		far_ay.resize(particles.size);
+
+		auto const timer = profiler.time(step_phase::integrate);
+		pool->for_each(everyone, [this, particles](size_t i) {
+			far_ax[i] = particles.ax[i] - near_ax[i];
+			far_ay[i] = particles.ay[i] - near_ay[i];
+		});
+	};
+
+	auto const kick = [&](float h, std::vector<float> const& kx, std::vector<float> const& ky) {
+		auto const timer = profiler.time(step_phase::integrate);
+		pool->for_each(everyone, [particles, h, &kx, &ky](size_t i) {
+			particles.vx[i] += h * kx[i];
+			particles.vy[i] += h * ky[i];
+		});
+	};
+
+	// The inner steps see the near field alone.
+	integrators::ops near_ops{
+		[&](float c) {
+			kick(c, near_ax, near_ay);
+		},
+		[&](float c) {
+			auto const timer = profiler.time(step_phase::integrate);
+			pool->for_each(everyone, [particles, c](size_t i) {
+				particles.x[i] += c * particles.vx[i];
+				particles.y[i] += c * particles.vy[i];
+			});
+		},
+		[&](float c) {
+			auto const timer = profiler.time(step_phase::integrate);
+			pool->for_each(everyone, [this, particles, c](size_t i) {
+				particles.x[i] += c * particles.vx[i] + (0.5f * c * c) * near_ax[i];
+				particles.y[i] += c * particles.vy[i] + (0.5f * c * c) * near_ay[i];
+			});
+		},
+		near_accelerations,
+		[&](float c) {
+			near_accelerations();
+			kick(c, near_ax, near_ay);
+		}
+	};
+
+	if (!split_current or far_ax.size() != particles.size or near_cutoff_used != split.cutoff or near_start_used != split.start) {
+		near_accelerations();
+		far_accelerations();
+	}
+	near_start_used = split.start;
+	near_cutoff_used = split.cutoff;
+
+	// Impulse r-RESPA: the far field kicks for half of h on either side of
+	// inner integrator steps under the near field alone. The outer step
+	// stays second order whatever the inner integrator is.
+	auto const inner_h = h / static_cast<float>(inner);
+
+	kick(0.5f * h, far_ax, far_ay);
+	for (unsigned s = 0; s < inner; ++s)
+		Integrator::step(near_ops, inner_h);
+	far_accelerations();
+	kick(0.5f * h, far_ax, far_ay);
+
+	split_current = true;
+	accelerations_current = true;
+}
+
+void simulation::spawn_particles(size_t num_dots) {
+	for (size_t i = 0; i < num_dots; ++i) {
+		float const theta = static_cast<float>(std::numbers::pi) * delta_dist(mt);
+		float const r = delta_dist(mt);
+
+		float const mass = 1836.f;
+		float const charge = 1.f;
+
+		float const x = width / 2 + placement_scale_factor * r * cos(theta) * smaller_dimension / 3;
+		float const y = height / 2 + placement_scale_factor * r * sin(theta) * smaller_dimension / 3;
+
+		add_particle(manager, species_registry, x, y, mass, charge);
+	}
+
+	for (size_t i = 0; i < num_dots * 3; ++i) {
+		float const theta = static_cast<float>(std::numbers::pi) * delta_dist(mt);
+		float const r = delta_dist(mt);
+
+		float const mass = 1837.f;
+		float const charge = 0.f;
+
+		float const x = width / 2 + placement_scale_factor * (1 - std::copysign(r, r)) * cos(theta) * smaller_dimension / 4;
+		float const y = height / 2 + placement_scale_factor * (1 - std::copysign(r, r)) * sin(theta) * smaller_dimension / 4;
+
+		add_particle(manager, species_registry, x, y, mass, charge);
+	}
+
+
+	for (size_t i = 0; i < num_dots; ++i) {
+		float const theta = static_cast<float>(std::numbers::pi) * delta_dist(mt);
+		float const raw_r = delta_dist(mt);
+		float const r = std::copysign(std::pow(raw_r, 2.f), raw_r);
+
+		float const mass = 1.f;
+		float const charge = -1.f;
+
+		float const x = width / 2 + placement_scale_factor * (1 - std::copysign(r * r, r)) * cos(theta) * smaller_dimension;
+		float const y = height / 2 + placement_scale_factor * (1 - std::copysign(r * r, r)) * sin(theta) * smaller_dimension;
+
+		add_particle(manager, species_registry, x, y, mass, charge);
+	}
+
+	particles_replaced();
+}
+
+float simulation::gen_random_float() {
+	return delta_dist(mt);
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "barnes_hut.hpp"
+#include "block_timesteps.hpp"
+#include "direct_sum_kernels.hpp"
+#include "force_accumulator.hpp"
+#include "integrators.hpp"
+#include "fast_multipole.hpp"
+#include "near_field.hpp"
+#include "neighbour_list.hpp"
+#include "pair_tiles.hpp"
+#include "particle_mesh.hpp"
+#include "point_particle.hpp"
+#include "step_profiler.hpp"
+#include "system_scheduler.hpp"
+#include "thread_pool.hpp"
+
+enum class force_solver {
+	direct_sum,
+	vectorized_direct_sum,
+	barnes_hut,
+	particle_mesh,
+	fast_multipole,
+	// Only the short-range laws (see registered_short_range_laws), over
+	// neighbours found like the near field's.
+	short_range
+};
+
+char const* force_solver_name(force_solver solver) noexcept;
+
+// Dense indices i with (x[i], y[i]) inside the box with corners (x0, y0) and
+// (x1, y1), in increasing order.
+std::vector<size_t> indices_in_box(std::span<float const> x, std::span<float const> y, float x0, float y0, float x1, float y1);
+
+// The physics core: particle storage, force solvers and the integrator.
+// Knows nothing about windows or drawing, so it can be driven by the SFML
+// front end or by the headless batch driver alike.
+class simulation {
+	using particle_systems = system_scheduler<point_particle_components>;
+
+public:
+	simulation();
+
+	void reserve(size_t desired_capacity) {
+		manager.reserve(desired_capacity);
+	}
+
+	// Reseeds the generator spawn_particles places particles with, which
+	// is otherwise seeded from std::random_device.
+	void seed(uint32_t value) {
+		mt.seed(value);
+	}
+
+	// Protons in a disc, neutrons in a ring around them and electrons
+	// further out, centered in a width x height region.
+	void spawn_particles(size_t num_dots = default_num_dots);
+
+	// Advances every particle by the timestep.
+	void step();
+
+	// Call after adding, removing or overwriting particles outside step(),
+	// so state carried between steps is rebuilt from the columns.
+	void particles_replaced() noexcept;
+
+	// Steps taken since spawning, or since the step a checkpoint was taken
+	// at. Only the stepping thread may set it.
+	uint64_t get_step_count() const noexcept {
+		return step_count;
+	}
+
+	void set_step_count(uint64_t steps) noexcept {
+		step_count = steps;
+	}
+
+	// Simulated time, the sum of the timesteps taken.
+	double get_elapsed_time() const noexcept {
+		return elapsed_time;
+	}
+
+	void set_elapsed_time(double time) noexcept {
+		elapsed_time = time;
+	}
+
+	// Handles of the particles inside the box with corners (x0, y0) and
+	// (x1, y1), in dense index order. Reads the live columns, so not while
+	// another thread is stepping.
+	std::vector<point_particle> particles_in_box(float x0, float y0, float x1, float y1) const;
+
+	// Runs the passes of step() on a work-stealing pool of that many
+	// threads, the stepping one included, optionally pinned to cores (see
+	// thread_pool.hpp). One per hardware thread until set. Waits for a step
+	// in progress to finish.
+	void set_threads(thread_pool::options const& settings);
+	unsigned get_threads() const noexcept;
+
+	// The setters are safe to call while another thread is stepping; they
+	// take effect at the start of the next step.
+	void set_force_solver(force_solver new_solver) noexcept;
+	force_solver get_force_solver() const noexcept;
+
+	void set_opening_angle(float theta) noexcept;
+
+	// Mesh size, assignment scheme and split of the particle-mesh solver
+	// (see particle_mesh.hpp).
+	void set_mesh(particle_mesh::settings const& settings) noexcept;
+	particle_mesh::settings get_mesh() const noexcept;
+
+	// Expansion order and separation of the fast multipole solver (see
+	// fast_multipole.hpp).
+	void set_multipole(fast_multipole::settings const& settings) noexcept;
+	fast_multipole::settings get_multipole() const noexcept;
+
+	// The scheme each step is taken with, kick-drift-kick leapfrog unless
+	// set (see integrators.hpp). Fourth order Forest-Ruth costs three force
+	// evaluations a step but keeps the energy error of a leapfrog run with
+	// a far shorter timestep.
+	void set_integrator(integrator which) noexcept;
+	integrator get_integrator() const noexcept;
+
+	// Length of one step, dt unless set.
+	void set_timestep(float step) noexcept;
+	float get_timestep() const noexcept;
+
+	// Makes the direct sum add up forces in a fixed order, so a run is
+	// bitwise reproducible for any thread count and scheduling. The
+	// vectorized and Barnes-Hut solvers already are. See step().
+	void set_deterministic(bool on) noexcept;
+	bool is_deterministic() const noexcept;
+
+	// With levels > 0, particles step on power-of-two fractions of the
+	// timestep down to 1 / 2^levels of it, picked from their acceleration,
+	// and each substep only evaluates forces on the particles finishing a
+	// step on it (see block_timesteps.hpp). Stepping is then kick-drift-kick
+	// leapfrog whatever the integrator. 0, the default, steps everyone by the
+	// whole timestep.
+	void set_timestep_levels(unsigned levels) noexcept;
+	unsigned get_timestep_levels() const noexcept;
+
+	// With steps > 1, each pair force is split by a smooth switch into a
+	// near part inside the cutoff and the far rest (see near_field.hpp).
+	// The far part comes from the force solver once per timestep, the near
+	// part from a grid neighbour search on each of the inner steps in
+	// between, taken with the integrator (impulse r-RESPA, symplectic like
+	// leapfrog). Ignored while timestep levels are on.
+	void set_inner_steps(unsigned steps) noexcept;
+	unsigned get_inner_steps() const noexcept;
+
+	// The near part is the whole force below switch_start and none of it
+	// beyond cutoff.
+	void set_near_field(float switch_start, float cutoff) noexcept;
+
+	static constexpr float default_near_start = 8.f;
+	static constexpr float default_near_cutoff = 16.f;
+
+	// How far past the cutoff the near part's Verlet lists reach, so the
+	// inner steps can reuse them until a particle has moved half of it
+	// (see neighbour_list.hpp). The short-range solver's lists reach as far
+	// past its cutoff. 0, the default, bins the particles again
+	// every time, as it only takes one fast particle to spoil the lists and
+	// the spawned disc always has some.
+	void set_near_skin(float skin) noexcept;
+
+	static constexpr float default_near_skin = 0.f;
+
+	// Particles per timestep level at the start of the last block step.
+	std::span<size_t const> timestep_population() const noexcept {
+		return timesteps.population();
+	}
+
+	size_t size() const noexcept {
+		return manager.size();
+	}
+
+	// Per-phase timings of step(), off until enabled.
+	step_profiler& get_profiler() noexcept {
+		return profiler;
+	}
+
+	EntityManagerType manager;
+
+	// The species of the particles in manager.
+	species_table species_registry;
+
+	static constexpr size_t width = 1280;
+	static constexpr size_t height = 720;
+	static constexpr size_t smaller_dimension = std::min(width, height);
+
+	static constexpr size_t default_num_dots = 1500;
+
+private:
+	float gen_random_float();
+
+	template<typename Integrator>
+	void step_with(particle_arrays const& particles, force_solver solver, float h);
+
+	template<typename Integrator>
+	void step_respa(particle_arrays const& particles, force_solver solver, unsigned inner, float h);
+
+	void step_blocks(particle_arrays const& particles, force_solver solver, unsigned levels, float h);
+
+	// 0, 1, ..., count - 1, kept around for passing everyone as a subset.
+	std::span<uint32_t const> all_particles(size_t count);
+
+	// Adds the pair forces of one tile into a leased force slot.
+	void slot_tile_forces(particle_arrays const& particles, pair_tiles::tile const& t);
+
+	// All pair forces added straight into fx and fy in an order that only
+	// depends on the particle count.
+	void round_forces(particle_arrays const& particles, pair_tiles const& tiles);
+
+	// Sets a = F / m for the given particles only, from every particle, and
+	// then adds kick * a to their velocities. Runs the pending systems first.
+	void accelerations_of(particle_arrays const& particles, force_solver solver, std::span<uint32_t const> subset, float kick = 0.f);
+
+	void run_pending(particle_arrays const& particles);
+
+	static constexpr float placement_scale_factor = 1.f;
+
+	std::random_device rd;
+	std::mt19937 mt;
+	std::uniform_real_distribution<float> delta_dist;
+
+	uint64_t step_count;
+	double elapsed_time;
+
+	std::atomic<force_solver> solver;
+	barnes_hut_tree tree;
+	std::atomic<float> opening_angle;
+	particle_mesh mesh;
+	std::atomic<size_t> mesh_cells;
+	std::atomic<mesh_assignment> assignment;
+	std::atomic<float> mesh_split;
+	fast_multipole multipole;
+	std::atomic<unsigned> multipole_order;
+	std::atomic<float> multipole_separation;
+	std::atomic<integrator> integration;
+	std::atomic<float> timestep;
+	std::atomic<bool> deterministic;
+	std::atomic<unsigned> timestep_levels;
+	block_timesteps timesteps;
+	std::atomic<unsigned> inner_steps;
+	std::atomic<float> near_start;
+	std::atomic<float> near_cutoff;
+	std::atomic<float> near_skin;
+	near_field near;
+	neighbour_list short_range_neighbours;
+
+	// ax and ay hold the accelerations at the current positions, as every
+	// kind of step leaves them.
+	bool accelerations_current;
+
+	// The near and far accelerations below match the positions and the
+	// switch they were computed with.
+	bool split_current;
+	float near_start_used = 0.f;
+	float near_cutoff_used = 0.f;
+	std::vector<float> near_ax;
+	std::vector<float> near_ay;
+	std::vector<float> far_ax;
+	std::vector<float> far_ay;
+
+	std::vector<uint32_t> all_indices;
+	std::unique_ptr<thread_pool> pool;
+	std::atomic<unsigned> thread_count;
+	task_graph force_graph;
+	particle_systems systems;
+	std::vector<particle_systems::system> pending;
+	direct_sum_kernel vector_kernel;
+	force_accumulator forces;
+	step_profiler profiler;
+
+	std::mutex interaction_lock;
+};
@@ -0,0 +1,121 @@
+#include "simulation_runner.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+simulation_runner::simulation_runner(simulation& sim)
+	: sim(sim),
+	steps(0),
+	paused_flag(true),
+	step_rate_limit(0.f),
+	checkpoint_requested(false) {
+}
+
+simulation_runner::~simulation_runner() {
+	stop();
+}
+
+void simulation_runner::start() {
+	if (worker.joinable())
+		return;
+
+	publish_snapshot();
+	worker = std::jthread([this](std::stop_token stop) { loop(stop); });
+}
+
+void simulation_runner::stop() {
+	if (!worker.joinable())
+		return;
+
+	// The stop token wakes the thread up if it is parked while paused.
+	worker.request_stop();
+	worker.join();
+	worker = std::jthread();
+	paused_flag.store(true);
+}
+
+void simulation_runner::set_paused(bool pause) noexcept {
+	{
+		std::scoped_lock l(control_lock);
+		paused_flag.store(pause);
+	}
+	control_changed.notify_all();
+}
+
+void simulation_runner::request_checkpoint(std::string path) {
+	{
+		std::scoped_lock l(control_lock);
+		checkpoint_path = std::move(path);
+		checkpoint_requested.store(true);
+	}
+	control_changed.notify_all();
+
+	// Without a thread there is nothing stepping, so it is safe to save here.
+	if (!worker.joinable())
+		save_requested_checkpoint();
+}
+
+void simulation_runner::wait_for_checkpoints() {
+	writer.wait();
+}
+
+void simulation_runner::save_requested_checkpoint() {
+	std::optional<std::string> path;
+	{
+		std::scoped_lock l(control_lock);
+		path.swap(checkpoint_path);
+		checkpoint_requested.store(false);
+	}
+
+	if (path)
+		writer.save_async(sim, std::move(*path));
+}
+
+void simulation_runner::loop(std::stop_token stop) {
+	using clock = std::chrono::steady_clock;
+	auto next_step = clock::now();
+
+	while (!stop.stop_requested()) {
+		if (checkpoint_requested.load())
+			save_requested_checkpoint();
+
+		if (paused_flag.load()) {
+			std::unique_lock l(control_lock);
+			control_changed.wait(l, stop, [this] { return !paused_flag.load() or checkpoint_requested.load(); });
+			next_step = clock::now();
+			continue;
+		}
+
+		sim.step();
+		++steps;
+		publish_snapshot();
+
+		auto const rate = step_rate_limit.load(std::memory_order_relaxed);
+		if (rate > 0.f) {
+			next_step += std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(1.f / rate));
+			// Don't try to catch up after a slow step.
+			next_step = std::max(next_step, clock::now() - std::chrono::milliseconds(100));
+			std::this_thread::sleep_until(next_step);
+		}
+	}
+}
+
+void simulation_runner::publish_snapshot() {
+	auto const& manager = sim.manager;
+	auto const x = manager.get_storage_for_component<PositionX>();
+	auto const y = manager.get_storage_for_component<PositionY>();
+
+	// The buffers keep their capacity, so this stops allocating once every
+	// one of the three has been filled.
+	auto& back = snapshots.back();
+	back.step = steps;
+	back.x.assign(x.begin(), x.end());
+	back.y.assign(y.begin(), y.end());
+	back.grid.build(x, y,
+		manager.get_storage_for_component<Mass>(),
+		manager.get_storage_for_component<Charge>(),
+		manager.get_storage_for_component<VelocityX>(),
+		manager.get_storage_for_component<VelocityY>());
+
+	snapshots.publish();
+}
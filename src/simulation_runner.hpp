@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "checkpoint.hpp"
+#include "simulation.hpp"
+#include "spatial_grid.hpp"
+#include "triple_buffer.hpp"
+
+// Particle positions as of the end of one step, in dense index order, and a
+// grid over them for selection queries.
+struct position_snapshot {
+	uint64_t step = 0;
+	std::vector<float> x;
+	std::vector<float> y;
+	spatial_grid grid;
+};
+
+// Steps a simulation on its own thread and publishes a position snapshot
+// after every step, so a front end can draw the latest finished state at its
+// own pace without ever waiting for a step. While the runner is alive, the
+// simulation must only be touched through its thread-safe setters.
+class simulation_runner {
+public:
+	explicit simulation_runner(simulation& sim);
+	~simulation_runner();
+
+	simulation_runner(simulation_runner const&) = delete;
+	simulation_runner& operator=(simulation_runner const&) = delete;
+
+	// Publishes the initial positions and starts the thread, paused.
+	void start();
+	void stop();
+
+	void set_paused(bool pause) noexcept;
+
+	bool paused() const noexcept {
+		return paused_flag.load(std::memory_order_relaxed);
+	}
+
+	// Upper bound on steps per second, 0 for as fast as possible.
+	void set_step_rate_limit(float steps_per_second) noexcept {
+		step_rate_limit.store(steps_per_second, std::memory_order_relaxed);
+	}
+
+	// Saves a checkpoint to path between two steps, also while paused. The
+	// file is written in the background; only the newest request is kept if
+	// several arrive before the simulation thread gets to them.
+	void request_checkpoint(std::string path);
+
+	// Blocks until every requested checkpoint is on disk.
+	void wait_for_checkpoints();
+
+	// Most recent snapshot the simulation thread finished. Only one thread
+	// may call this, and the reference is valid until its next call.
+	position_snapshot const& latest() noexcept {
+		snapshots.update();
+		return snapshots.front();
+	}
+
+private:
+	void loop(std::stop_token stop);
+	void publish_snapshot();
+	void save_requested_checkpoint();
+
+	simulation& sim;
+	uint64_t steps;
+
+	triple_buffer<position_snapshot> snapshots;
+
+	std::atomic<bool> paused_flag;
+	std::atomic<float> step_rate_limit;
+
+	// Guards checkpoint_path and lets a paused thread wake up for a save.
+	std::mutex control_lock;
+	std::condition_variable_any control_changed;
+	std::optional<std::string> checkpoint_path;
+	std::atomic<bool> checkpoint_requested;
+	checkpoint_writer writer;
+
+	std::jthread worker;
+};
@@ -0,0 +1,228 @@
+#include "spatial_grid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+particle_summary& particle_summary::operator+=(particle_summary const& other) noexcept {
+	count += other.count;
+	mass += other.mass;
+	charge += other.charge;
+	momentum_x += other.momentum_x;
+	momentum_y += other.momentum_y;
+	scalar_momentum += other.scalar_momentum;
+	return *this;
+}
+
+void spatial_grid::build(std::span<float const> x, std::span<float const> y,
+	std::span<float const> mass, std::span<float const> charge,
+	std::span<float const> vx, std::span<float const> vy) {
+	auto const n = x.size();
+
+	min_x = std::numeric_limits<float>::max();
+	min_y = std::numeric_limits<float>::max();
+	max_x = std::numeric_limits<float>::lowest();
+	max_y = std::numeric_limits<float>::lowest();
+
+	for (size_t i = 0; i < n; ++i) {
+		min_x = std::min(min_x, x[i]);
+		min_y = std::min(min_y, y[i]);
+		max_x = std::max(max_x, x[i]);
+		max_y = std::max(max_y, y[i]);
+	}
+
+	if (n == 0) {
+		min_x = min_y = max_x = max_y = 0.f;
+	}
+
+	// Square cells sized for about target_per_cell particles each if they
+	// were spread evenly, but never so small that the grid gets huge.
+	auto const width = max_x - min_x;
+	auto const height = max_y - min_y;
+	auto const extent = std::max({ width, height, 1e-3f });
+	auto const wanted_cells = static_cast<float>(std::max<size_t>(1, n / target_per_cell));
+	auto const area = std::max(width * height, extent * extent / wanted_cells);
+
+	cell_size = std::max(std::sqrt(area / wanted_cells), extent / max_cells_per_side);
+	inverse_cell_size = 1.f / cell_size;
+	columns = std::min(max_cells_per_side, static_cast<size_t>(width * inverse_cell_size) + 1);
+	rows = std::min(max_cells_per_side, static_cast<size_t>(height * inverse_cell_size) + 1);
+
+	auto const cell_count = columns * rows;
+
+	cell_start.assign(cell_count + 1, 0);
+	cell_summaries.assign(cell_count, particle_summary{});
+	cell_of_particle.resize(n);
+
+	for (size_t i = 0; i < n; ++i) {
+		auto const c = row_of(y[i]) * columns + column_of(x[i]);
+		cell_of_particle[i] = static_cast<uint32_t>(c);
+		++cell_start[c + 1];
+	}
+
+	for (size_t c = 0; c < cell_count; ++c)
+		cell_start[c + 1] += cell_start[c];
+
+	sorted_index.resize(n);
+	sorted_x.resize(n);
+	sorted_y.resize(n);
+	sorted_mass.resize(n);
+	sorted_charge.resize(n);
+	sorted_vx.resize(n);
+	sorted_vy.resize(n);
+
+	// Scatter, using the cell summaries' counts as the fill cursors.
+	for (size_t i = 0; i < n; ++i) {
+		auto const c = cell_of_particle[i];
+		auto const s = cell_start[c] + cell_summaries[c].count;
+
+		sorted_index[s] = static_cast<uint32_t>(i);
+		sorted_x[s] = x[i];
+		sorted_y[s] = y[i];
+		sorted_mass[s] = mass[i];
+		sorted_charge[s] = charge[i];
+		sorted_vx[s] = vx[i];
+		sorted_vy[s] = vy[i];
+
+		cell_summaries[c] += summary_of(s);
+	}
+}
+
+size_t spatial_grid::column_of(float x) const noexcept {
+	auto const c = (x - min_x) * inverse_cell_size;
+	return !(c > 0.f) ? 0 : std::min(columns - 1, static_cast<size_t>(c));
+}
+
+size_t spatial_grid::row_of(float y) const noexcept {
+	auto const r = (y - min_y) * inverse_cell_size;
+	return !(r > 0.f) ? 0 : std::min(rows - 1, static_cast<size_t>(r));
+}
+
+spatial_grid::cell_range spatial_grid::cells_overlapping(float lx, float ly, float bx, float by) const noexcept {
+	return cell_range{ column_of(lx), column_of(bx), row_of(ly), row_of(by) };
+}
+
+particle_summary spatial_grid::summary_of(size_t s) const noexcept {
+	auto const m = sorted_mass[s];
+	return particle_summary{
+		1,
+		m,
+		sorted_charge[s],
+		m * sorted_vx[s],
+		m * sorted_vy[s],
+		m * std::hypot(sorted_vx[s], sorted_vy[s])
+	};
+}
+
+template<typename Inside, typename CellInside, typename WholeCell, typename Particle>
+void spatial_grid::visit(cell_range range, Inside&& inside, CellInside&& cell_inside, WholeCell&& whole_cell, Particle&& particle) const {
+	for (auto row = range.first_row; row <= range.last_row; ++row) {
+		for (auto column = range.first_column; column <= range.last_column; ++column) {
+			auto const c = row * columns + column;
+			if (cell_summaries[c].count == 0)
+				continue;
+
+			if (cell_inside(column, row)) {
+				whole_cell(c);
+				continue;
+			}
+
+			for (auto s = cell_start[c]; s < cell_start[c + 1]; ++s) {
+				if (inside(sorted_x[s], sorted_y[s]))
+					particle(s);
+			}
+		}
+	}
+}
+
+template<typename WholeCell, typename Particle>
+void spatial_grid::visit_box(float x0, float y0, float x1, float y1, WholeCell&& whole_cell, Particle&& particle) const {
+	auto const lx = std::min(x0, x1);
+	auto const ly = std::min(y0, y1);
+	auto const bx = std::max(x0, x1);
+	auto const by = std::max(y0, y1);
+
+	if (size() == 0 or bx < min_x or lx > max_x or by < min_y or ly > max_y)
+		return;
+
+	auto const range = cells_overlapping(lx, ly, bx, by);
+
+	// Cell membership comes from the same monotonic column_of/row_of, so a
+	// cell strictly between the edge cells is inside no matter how the
+	// particle positions round.
+	auto const cell_inside = [&](size_t column, size_t row) {
+		return (column > range.first_column or lx <= min_x)
+			and (column < range.last_column or bx >= max_x)
+			and (row > range.first_row or ly <= min_y)
+			and (row < range.last_row or by >= max_y);
+	};
+
+	auto const inside = [&](float x, float y) {
+		return lx <= x and x <= bx and ly <= y and y <= by;
+	};
+
+	visit(range, inside, cell_inside, whole_cell, particle);
+}
+
+template<typename WholeCell, typename Particle>
+void spatial_grid::visit_radius(float cx, float cy, float r, WholeCell&& whole_cell, Particle&& particle) const {
+	if (size() == 0 or r < 0.f)
+		return;
+
+	auto const range = cells_overlapping(cx - r, cy - r, cx + r, cy + r);
+	auto const r_squared = r * r;
+
+	// Positions can round into a neighbouring cell, so the corners get a
+	// little slack before a cell is taken whole.
+	auto const slack = 1e-3f * cell_size;
+	auto const cell_inside = [&](size_t column, size_t row) {
+		auto const left = min_x + column * cell_size - slack;
+		auto const bottom = min_y + row * cell_size - slack;
+		auto const far_x = std::max(std::abs(left - cx), std::abs(left + cell_size + 2 * slack - cx));
+		auto const far_y = std::max(std::abs(bottom - cy), std::abs(bottom + cell_size + 2 * slack - cy));
+		return far_x * far_x + far_y * far_y <= r_squared;
+	};
+
+	auto const inside = [&](float x, float y) {
+		return (x - cx) * (x - cx) + (y - cy) * (y - cy) <= r_squared;
+	};
+
+	visit(range, inside, cell_inside, whole_cell, particle);
+}
+
+std::vector<size_t> spatial_grid::query_box(float x0, float y0, float x1, float y1) const {
+	std::vector<size_t> hits;
+	visit_box(x0, y0, x1, y1,
+		[&](size_t c) { hits.insert(hits.end(), sorted_index.begin() + cell_start[c], sorted_index.begin() + cell_start[c + 1]); },
+		[&](size_t s) { hits.push_back(sorted_index[s]); });
+	return hits;
+}
+
+particle_summary spatial_grid::summarize_box(float x0, float y0, float x1, float y1) const {
+	particle_summary total;
+	visit_box(x0, y0, x1, y1,
+		[&](size_t c) { total += cell_summaries[c]; },
+		[&](size_t s) { total += summary_of(s); });
+	return total;
+}
+
+std::vector<size_t> spatial_grid::query_radius(float cx, float cy, float r) const {
+	std::vector<size_t> hits;
+	query_radius(cx, cy, r, hits);
+	return hits;
+}
+
+void spatial_grid::query_radius(float cx, float cy, float r, std::vector<size_t>& hits) const {
+	hits.clear();
+	visit_radius(cx, cy, r,
+		[&](size_t c) { hits.insert(hits.end(), sorted_index.begin() + cell_start[c], sorted_index.begin() + cell_start[c + 1]); },
+		[&](size_t s) { hits.push_back(sorted_index[s]); });
+}
+
+particle_summary spatial_grid::summarize_radius(float cx, float cy, float r) const {
+	particle_summary total;
+	visit_radius(cx, cy, r,
+		[&](size_t c) { total += cell_summaries[c]; },
+		[&](size_t s) { total += summary_of(s); });
+	return total;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Totals over a set of particles. Momentum is summed as a vector and as
+// magnitudes, the latter for the average speed-like figure the front end
+// prints.
+struct particle_summary {
+	size_t count = 0;
+	float mass = 0.f;
+	float charge = 0.f;
+	float momentum_x = 0.f;
+	float momentum_y = 0.f;
+	float scalar_momentum = 0.f;
+
+	particle_summary& operator+=(particle_summary const& other) noexcept;
+};
+
+// Uniform grid over the bounding box of the particles, rebuilt with a
+// counting sort in O(N). Particles are stored grouped by cell along with
+// per-cell summaries, so box and radius queries only look at individual
+// particles in the cells the query boundary passes through; cells entirely
+// inside are taken whole.
+class spatial_grid {
+public:
+	static constexpr size_t target_per_cell = 16;
+	static constexpr size_t max_cells_per_side = 4096;
+
+	// All spans are indexed by dense particle index and must be the same
+	// length.
+	void build(std::span<float const> x, std::span<float const> y,
+		std::span<float const> mass, std::span<float const> charge,
+		std::span<float const> vx, std::span<float const> vy);
+
+	size_t size() const noexcept {
+		return sorted_index.size();
+	}
+
+	// Dense indices inside the box with corners (x0, y0) and (x1, y1),
+	// edges included, grouped by cell. Same set as indices_in_box().
+	std::vector<size_t> query_box(float x0, float y0, float x1, float y1) const;
+	particle_summary summarize_box(float x0, float y0, float x1, float y1) const;
+
+	// Dense indices within distance r of (cx, cy).
+	std::vector<size_t> query_radius(float cx, float cy, float r) const;
+
+	// Same, into hits, which is cleared first and keeps its capacity so
+	// repeated queries settle into no allocation.
+	void query_radius(float cx, float cy, float r, std::vector<size_t>& hits) const;
+	particle_summary summarize_radius(float cx, float cy, float r) const;
+
+private:
+	struct cell_range {
+		size_t first_column;
+		size_t last_column;
+		size_t first_row;
+		size_t last_row;
+	};
+
+	size_t column_of(float x) const noexcept;
+	size_t row_of(float y) const noexcept;
+	cell_range cells_overlapping(float lx, float ly, float bx, float by) const noexcept;
+
+	// Calls whole_cell(c) for cells known to be entirely inside the region
+	// and particle(s) for every sorted slot s of the other overlapping cells
+	// that passes inside(x, y).
+	template<typename Inside, typename CellInside, typename WholeCell, typename Particle>
+	void visit(cell_range range, Inside&& inside, CellInside&& cell_inside, WholeCell&& whole_cell, Particle&& particle) const;
+
+	template<typename WholeCell, typename Particle>
+	void visit_box(float x0, float y0, float x1, float y1, WholeCell&& whole_cell, Particle&& particle) const;
+
+	template<typename WholeCell, typename Particle>
+	void visit_radius(float cx, float cy, float r, WholeCell&& whole_cell, Particle&& particle) const;
+
+	particle_summary summary_of(size_t s) const noexcept;
+
+	float min_x = 0.f;
+	float min_y = 0.f;
+	float max_x = 0.f;
+	float max_y = 0.f;
+	float cell_size = 1.f;
+	float inverse_cell_size = 1.f;
+	size_t columns = 0;
+	size_t rows = 0;
+
+	// cell_start[c] .. cell_start[c + 1] are the sorted slots of cell c.
+	std::vector<uint32_t> cell_start;
+	std::vector<particle_summary> cell_summaries;
+
+	std::vector<uint32_t> cell_of_particle;
+	std::vector<uint32_t> sorted_index;
+	std::vector<float> sorted_x;
+	std::vector<float> sorted_y;
+	std::vector<float> sorted_mass;
+	std::vector<float> sorted_charge;
+	std::vector<float> sorted_vx;
+	std::vector<float> sorted_vy;
+};
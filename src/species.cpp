@@ -0,0 +1,29 @@
+#include "species.hpp"
+
+#include <algorithm>
+
+#include "force_laws.hpp"
+
+uint8_t species_table::id_of(float mass, float charge) {
+	auto const found = std::find_if(kinds.begin(), kinds.end(), [mass, charge](species const& s) { return s.mass == mass and s.charge == charge; });
+	if (found != kinds.end())
+		return static_cast<uint8_t>(found - kinds.begin());
+
+	if (kinds.size() == max_species) {
+		full = true;
+		return 0;
+	}
+	kinds.push_back({ mass, charge });
+
+	// Few species are ever registered, so the whole table is simply redone.
+	if constexpr (requires (species const& s) { pair_force::coupling(s, s); }) {
+		auto const n = kinds.size();
+		coupling_table.resize(n * n);
+		for (size_t a = 0; a < n; ++a) {
+			for (size_t b = 0; b < n; ++b)
+				coupling_table[a * n + b] = pair_force::coupling(kinds[a], kinds[b]);
+		}
+	}
+
+	return static_cast<uint8_t>(kinds.size() - 1);
+}
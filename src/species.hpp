@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What every particle of a species shares.
+struct species {
+	float mass;
+	float charge;
+};
+
+// The species the particles belong to, so each particle stores a byte
+// naming its species and the pair passes look up what the registered laws
+// make of two species instead of multiplying out masses and charges.
+class species_table {
+public:
+	// Ids have to fit in the byte each particle stores.
+	static constexpr size_t max_species = 256;
+
+	// The id of the species with this mass and charge, registering it if it
+	// is new. Past max_species every new one gets id 0 and overflowed()
+	// turns true, after which the ids mean nothing.
+	uint8_t id_of(float mass, float charge);
+
+	size_t size() const noexcept {
+		return kinds.size();
+	}
+
+	species const& operator[](uint8_t id) const noexcept {
+		return kinds[id];
+	}
+
+	bool overflowed() const noexcept {
+		return full;
+	}
+
+	// The couplings of every pair of species, the coupling of a and b at
+	// a * size() + b, or null if some registered law has none (see
+	// fused_interaction::coupling).
+	float const* couplings() const noexcept {
+		return coupling_table.empty() ? nullptr : coupling_table.data();
+	}
+
+private:
+	std::vector<species> kinds;
+	std::vector<float> coupling_table;
+	bool full = false;
+};
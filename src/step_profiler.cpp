@@ -0,0 +1,171 @@
+#include "step_profiler.hpp"
+
+#include <algorithm>
+#include <bit>
+
+#include <fmt/format.h>
+
+char const* step_phase_name(step_phase phase) noexcept {
+	switch (phase) {
+	case step_phase::build_tree:
+		return "build_tree";
+	case step_phase::pair_interaction:
+		return "pair_interaction";
+	case step_phase::integrate:
+		return "integrate";
+	default:
+		return "unknown";
+	}
+}
+
+rolling_histogram::rolling_histogram(size_t window)
+	: samples(std::max<size_t>(1, window), 0),
+	next(0),
+	filled(0),
+	sum(0),
+	counts{} {
+}
+
+size_t rolling_histogram::bucket_of(uint64_t nanoseconds) noexcept {
+	if (nanoseconds == 0)
+		return 0;
+	return std::min<size_t>(bucket_count - 1, std::bit_width(nanoseconds) - 1);
+}
+
+void rolling_histogram::add(uint64_t nanoseconds) {
+	if (filled == samples.size()) {
+		auto const evicted = samples[next];
+		--counts[bucket_of(evicted)];
+		sum -= evicted;
+	}
+	else {
+		++filled;
+	}
+
+	samples[next] = nanoseconds;
+	++counts[bucket_of(nanoseconds)];
+	sum += nanoseconds;
+	next = (next + 1) % samples.size();
+}
+
+double rolling_histogram::mean() const noexcept {
+	return filled == 0 ? 0.0 : static_cast<double>(sum) / filled;
+}
+
+uint64_t rolling_histogram::percentile(double q) const {
+	if (filled == 0)
+		return 0;
+
+	std::vector<uint64_t> window(samples.begin(), samples.begin() + filled);
+	auto const rank = static_cast<size_t>(std::clamp(q, 0.0, 1.0) * (filled - 1));
+	std::nth_element(window.begin(), window.begin() + rank, window.end());
+	return window[rank];
+}
+
+step_profiler::scoped_timer::scoped_timer(step_profiler* owner, step_phase phase) noexcept
+	: owner(owner),
+	phase(phase) {
+	if (owner)
+		start = clock::now();
+}
+
+step_profiler::scoped_timer::~scoped_timer() {
+	if (!owner)
+		return;
+
+	auto const elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+	owner->current.phase_ns[static_cast<size_t>(phase)] += elapsed.count();
+}
+
+step_profiler::step_profiler(size_t histogram_window)
+	: enabled_flag(false),
+	active(false),
+	steps(0),
+	current{},
+	last{},
+	total_histogram(histogram_window),
+	format(export_format::csv) {
+	phase_histograms.fill(rolling_histogram(histogram_window));
+}
+
+bool step_profiler::export_to(std::string const& path, export_format new_format) {
+	std::unique_ptr<std::FILE, file_closer> file(std::fopen(path.c_str(), "w"));
+	if (!file)
+		return false;
+
+	output = std::move(file);
+	format = new_format;
+
+	if (format == export_format::csv) {
+		fmt::print(output.get(), "step,total_ns");
+		for (size_t p = 0; p < static_cast<size_t>(step_phase::count); ++p)
+			fmt::print(output.get(), ",{}_ns", step_phase_name(static_cast<step_phase>(p)));
+		fmt::print(output.get(), ",pairs_evaluated,particles_moved\n");
+	}
+
+	return true;
+}
+
+void step_profiler::stop_export() noexcept {
+	output.reset();
+}
+
+void step_profiler::begin_step() noexcept {
+	active = enabled();
+	if (!active)
+		return;
+
+	current = step_record{};
+	current.step = steps;
+	step_start = clock::now();
+}
+
+void step_profiler::end_step(uint64_t particles_moved) {
+	++steps;
+	if (!active)
+		return;
+	active = false;
+
+	auto const elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - step_start);
+	current.total_ns = elapsed.count();
+	current.particles_moved = particles_moved;
+
+	for (size_t p = 0; p < phase_histograms.size(); ++p)
+		phase_histograms[p].add(current.phase_ns[p]);
+	total_histogram.add(current.total_ns);
+
+	last = current;
+
+	if (output)
+		write_record(last);
+}
+
+void step_profiler::write_record(step_record const& record) {
+	auto* const out = output.get();
+
+	if (format == export_format::csv) {
+		fmt::print(out, "{},{}", record.step, record.total_ns);
+		for (auto const ns : record.phase_ns)
+			fmt::print(out, ",{}", ns);
+		fmt::print(out, ",{},{}\n", record.pairs_evaluated, record.particles_moved);
+		return;
+	}
+
+	fmt::print(out, "{{\"step\":{},\"total_ns\":{},\"phases\":{{", record.step, record.total_ns);
+	for (size_t p = 0; p < record.phase_ns.size(); ++p)
+		fmt::print(out, "{}\"{}\":{}", p == 0 ? "" : ",", step_phase_name(static_cast<step_phase>(p)), record.phase_ns[p]);
+	fmt::print(out, "}},\"pairs_evaluated\":{},\"particles_moved\":{}}}\n", record.pairs_evaluated, record.particles_moved);
+}
+
+void step_profiler::print_summary() const {
+	auto const print_line = [](char const* name, rolling_histogram const& h) {
+		fmt::print("{:>18}: mean {:9.3f} ms, p50 {:9.3f} ms, p99 {:9.3f} ms\n",
+			name, h.mean() * 1e-6, h.percentile(0.5) * 1e-6, h.percentile(0.99) * 1e-6);
+	};
+
+	fmt::print("Last {} steps, {} pairs and {} particles in the latest\n",
+		total_histogram.size(), last.pairs_evaluated, last.particles_moved);
+	for (size_t p = 0; p < phase_histograms.size(); ++p)
+		print_line(step_phase_name(static_cast<step_phase>(p)), phase_histograms[p]);
+	print_line("step", total_histogram);
+}
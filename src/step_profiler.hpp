@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// The phases of step() the profiler times. Not every solver has every
+// phase; the ones it skips read as zero. Clearing the forces is fused into
+// the sweeps around it, so it counts towards theirs.
+enum class step_phase : uint8_t {
+	// Building the Barnes-Hut tree, solving on the particle mesh, forming
+	// the multipole expansions, or finding the short-range neighbours.
+	build_tree,
+	pair_interaction,
+	integrate,
+	count
+};
+
+char const* step_phase_name(step_phase phase) noexcept;
+
+// Durations of the last `window` samples, bucketed by powers of two of
+// nanoseconds. Buckets are kept up to date on every add, percentiles are
+// worked out from the raw window when asked for.
+class rolling_histogram {
+public:
+	static constexpr size_t bucket_count = 40;
+
+	explicit rolling_histogram(size_t window = 256);
+
+	void add(uint64_t nanoseconds);
+
+	// Bucket b counts samples in [2^b, 2^(b+1)) ns, bucket 0 also takes 0.
+	std::array<uint32_t, bucket_count> const& buckets() const noexcept {
+		return counts;
+	}
+
+	size_t size() const noexcept {
+		return filled;
+	}
+
+	double mean() const noexcept;
+	uint64_t percentile(double q) const;
+
+private:
+	static size_t bucket_of(uint64_t nanoseconds) noexcept;
+
+	std::vector<uint64_t> samples;
+	size_t next;
+	size_t filled;
+	uint64_t sum;
+	std::array<uint32_t, bucket_count> counts;
+};
+
+// Per-phase timers and per-step counters for simulation::step(). Disabled
+// it costs one relaxed load per phase; enabled it is two clock reads per
+// phase plus a few adds at the end of the step. Optionally appends every
+// step to a CSV or JSON-lines file.
+class step_profiler {
+public:
+	using clock = std::chrono::steady_clock;
+
+	enum class export_format {
+		csv,
+		json
+	};
+
+	struct step_record {
+		uint64_t step;
+		std::array<uint64_t, static_cast<size_t>(step_phase::count)> phase_ns;
+		uint64_t total_ns;
+		uint64_t pairs_evaluated;
+		uint64_t particles_moved;
+	};
+
+	class scoped_timer {
+	public:
+		scoped_timer(scoped_timer const&) = delete;
+		scoped_timer& operator=(scoped_timer const&) = delete;
+		~scoped_timer();
+
+	private:
+		friend class step_profiler;
+		scoped_timer(step_profiler* owner, step_phase phase) noexcept;
+
+		step_profiler* owner;
+		step_phase phase;
+		clock::time_point start;
+	};
+
+	explicit step_profiler(size_t histogram_window = 256);
+
+	// Safe to flip from another thread; takes effect at the next step.
+	void set_enabled(bool on) noexcept {
+		enabled_flag.store(on, std::memory_order_relaxed);
+	}
+
+	bool enabled() const noexcept {
+		return enabled_flag.load(std::memory_order_relaxed);
+	}
+
+	// Every following step is appended to path. Returns false if the file
+	// cannot be opened.
+	bool export_to(std::string const& path, export_format format);
+	void stop_export() noexcept;
+
+	void begin_step() noexcept;
+	void end_step(uint64_t particles_moved);
+
+	[[nodiscard]] scoped_timer time(step_phase phase) noexcept {
+		return scoped_timer(active ? this : nullptr, phase);
+	}
+
+	void add_pairs(uint64_t pairs) noexcept {
+		if (active)
+			current.pairs_evaluated += pairs;
+	}
+
+	// True between begin_step and end_step of a step that is being
+	// recorded, for callers that want to skip extra counting otherwise.
+	bool recording() const noexcept {
+		return active;
+	}
+
+	step_record const& last_step() const noexcept {
+		return last;
+	}
+
+	rolling_histogram const& histogram(step_phase phase) const noexcept {
+		return phase_histograms[static_cast<size_t>(phase)];
+	}
+
+	rolling_histogram const& step_histogram() const noexcept {
+		return total_histogram;
+	}
+
+	// Mean and tail latency of every phase over the histogram window.
+	void print_summary() const;
+
+private:
+	struct file_closer {
+		void operator()(std::FILE* f) const noexcept {
+			std::fclose(f);
+		}
+	};
+
+	void write_record(step_record const& record);
+
+	std::atomic<bool> enabled_flag;
+	bool active;
+	uint64_t steps;
+	clock::time_point step_start;
+
+	step_record current;
+	step_record last;
+
+	std::array<rolling_histogram, static_cast<size_t>(step_phase::count)> phase_histograms;
+	rolling_histogram total_histogram;
+
+	std::unique_ptr<std::FILE, file_closer> output;
+	export_format format;
+};
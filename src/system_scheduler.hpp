@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "TypeList.hpp"
+#include "thread_pool.hpp"
+
+// What a system touches, as component tag types.
+template<typename... Components>
+struct reads { };
+
+template<typename... Components>
+struct writes { };
+
+template<typename ComponentTypeList>
+class system_scheduler;
+
+// Runs a list of systems over the entities of an EntityManager whose
+// components are ComponentTypes. The result is as if the systems ran one
+// after another in the order given, but
+//
+// - adjacent per-entity systems are fused, so they share one sweep over the
+//   entities: each block of entities small enough to stay in cache goes
+//   through all of them before the next block is loaded, instead of every
+//   system streaming all the columns in from memory again;
+// - systems, or fused groups, that neither write what the other reads or
+//   writes run concurrently, as nodes of one task graph.
+//
+// The declared access is trusted. State outside the manager's components
+// is not tracked, so systems sharing any must be ordered by other means.
+template<typename... ComponentTypes>
+class system_scheduler<ListsViaTypes::TypeList<ComponentTypes...>> {
+	using component_list = ListsViaTypes::TypeList<ComponentTypes...>;
+
+public:
+	using component_mask = uint64_t;
+	static_assert(sizeof...(ComponentTypes) <= 64, "system_scheduler tracks at most 64 components.");
+
+	// Entities per block of a fused sweep. A dozen float columns of 1024
+	// entities is about 48 KiB, around the size of L2 per core slice.
+	static constexpr size_t default_block_size = 1024;
+
+	struct system {
+		component_mask read = 0;
+		component_mask written = 0;
+		bool per_entity = false;
+
+		// Per-entity systems are handed ranges of entities, the others are
+		// called once with the whole range.
+		std::function<void(size_t first, size_t last)> body;
+	};
+
+	template<typename... Cs>
+	static constexpr component_mask mask_of() noexcept {
+		return (component_mask(0) | ... | (component_mask(1) << component_list::template get_index_of<Cs>()));
+	}
+
+	// f(i) for every entity i, which may only read and write entity i's
+	// components; that is what makes fusing it with its neighbours safe.
+	template<typename... R, typename... W, typename Function>
+	static system each_entity(reads<R...>, writes<W...>, Function f) {
+		return { mask_of<R...>(), mask_of<W...>(), true, [f = std::move(f)](size_t first, size_t last) {
+			for (auto i = first; i < last; ++i)
+				f(i);
+		} };
+	}
+
+	// f() once, free to touch any entity within what it declares, like a
+	// pair pass, and to run parallel loops of its own on the pool.
+	template<typename... R, typename... W, typename Function>
+	static system once(reads<R...>, writes<W...>, Function f) {
+		return { mask_of<R...>(), mask_of<W...>(), false, [f = std::move(f)](size_t, size_t) {
+			f();
+		} };
+	}
+
+	explicit system_scheduler(size_t block_size = default_block_size) noexcept
+		: block_size(block_size == 0 ? 1 : block_size) {
+	}
+
+	void run(thread_pool& pool, size_t entity_count, std::span<system const> systems) {
+		build_stages(systems);
+
+		graph.clear();
+		std::vector<task_graph::node> nodes;
+		nodes.reserve(stages.size());
+
+		auto const blocks = (entity_count + block_size - 1) / block_size;
+		for (auto const& s : stages) {
+			auto const members = std::span(systems).subspan(s.first, s.count);
+
+			if (s.per_entity) {
+				nodes.push_back(graph.add(blocks, [this, members, entity_count](size_t b) {
+					auto const first = b * block_size;
+					auto const last = std::min(entity_count, first + block_size);
+					for (auto const& member : members)
+						member.body(first, last);
+				}));
+			}
+			else {
+				nodes.push_back(graph.add(1, [members, entity_count](size_t) {
+					members.front().body(0, entity_count);
+				}));
+			}
+		}
+
+		// Every conflicting earlier stage, not just the latest, so that two
+		// concurrent readers both finish before the next writer.
+		for (size_t later = 0; later < stages.size(); ++later) {
+			for (size_t earlier = 0; earlier < later; ++earlier) {
+				if (conflict(stages[earlier], stages[later]))
+					graph.precede(nodes[earlier], nodes[later]);
+			}
+		}
+
+		pool.run(graph);
+	}
+
+	template<typename... Systems>
+		requires (std::is_convertible_v<Systems, system> and ...)
+	void run(thread_pool& pool, size_t entity_count, Systems&&... systems) {
+		std::array<system, sizeof...(Systems)> const list{ std::forward<Systems>(systems)... };
+		run(pool, entity_count, std::span<system const>(list));
+	}
+
+	// Sweeps or single calls the last run() was turned into.
+	size_t stage_count() const noexcept {
+		return stages.size();
+	}
+
+private:
+	struct stage {
+		size_t first;
+		size_t count;
+		bool per_entity;
+		component_mask read;
+		component_mask written;
+	};
+
+	static bool conflict(stage const& a, stage const& b) noexcept {
+		return (a.written & (b.read | b.written)) != 0 or (a.read & b.written) != 0;
+	}
+
+	void build_stages(std::span<system const> systems) {
+		stages.clear();
+		for (size_t k = 0; k < systems.size(); ++k) {
+			auto const& s = systems[k];
+			if (s.per_entity and !stages.empty() and stages.back().per_entity) {
+				auto& fused = stages.back();
+				++fused.count;
+				fused.read |= s.read;
+				fused.written |= s.written;
+			}
+			else {
+				stages.push_back({ k, 1, s.per_entity, s.read, s.written });
+			}
+		}
+	}
+
+	size_t block_size;
+	std::vector<stage> stages;
+	task_graph graph;
+};
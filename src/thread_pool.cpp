@@ -0,0 +1,227 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+	// The pool and queue a thread works from, set for workers for their
+	// whole life and for an outside caller for the length of its call.
+	thread_local thread_pool const* current_pool = nullptr;
+	thread_local unsigned current_queue = 0;
+
+	void pin_to_core(std::jthread& thread, unsigned core) {
+		auto const cores = std::max(1u, std::thread::hardware_concurrency());
+		core %= cores;
+#if defined(_WIN32)
+		SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << core);
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(core, &set);
+		pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+		(void)thread;
+		(void)core;
+#endif
+	}
+
+	// Workers spin this many times looking for work before sleeping, as
+	// passes in a step follow each other closely.
+	constexpr unsigned idle_spins = 2000;
+
+}
+
+class thread_pool::participant {
+public:
+	explicit participant(thread_pool& pool) {
+		if (current_pool == &pool) {
+			index = current_queue;
+			return;
+		}
+
+		outside.emplace(pool.caller_lock);
+		previous_pool = current_pool;
+		previous_queue = current_queue;
+		current_pool = &pool;
+		current_queue = 0;
+		index = 0;
+	}
+
+	~participant() {
+		if (outside) {
+			current_pool = previous_pool;
+			current_queue = previous_queue;
+		}
+	}
+
+	unsigned index;
+
+private:
+	std::optional<std::unique_lock<std::mutex>> outside;
+	thread_pool const* previous_pool = nullptr;
+	unsigned previous_queue = 0;
+};
+
+thread_pool::thread_pool()
+	: thread_pool(options{}) {
+}
+
+thread_pool::thread_pool(options const& settings)
+	: queues(settings.threads != 0 ? settings.threads : std::max(1u, std::thread::hardware_concurrency())) {
+	workers.reserve(queues.size() - 1);
+	for (unsigned k = 1; k < queues.size(); ++k) {
+		workers.emplace_back([this, k](std::stop_token stop) { loop(stop, k); });
+		if (settings.pin)
+			pin_to_core(workers.back(), k);
+	}
+}
+
+thread_pool::~thread_pool() {
+	for (auto& worker : workers)
+		worker.request_stop();
+	// request_stop wakes the sleepers through their stop token.
+	workers.clear();
+}
+
+void thread_pool::loop(std::stop_token stop, unsigned self) {
+	current_pool = this;
+	current_queue = self;
+
+	while (!stop.stop_requested()) {
+		auto const seen = pushes.load();
+
+		std::optional<task> t;
+		for (unsigned spin = 0; spin < idle_spins and !t and !stop.stop_requested(); ++spin) {
+			if (!(t = pop(self)) and !(t = steal(self)))
+				std::this_thread::yield();
+		}
+
+		if (t) {
+			execute(*t, self);
+			continue;
+		}
+
+		// Anything pushed after seen was read changes pushes, so checking it
+		// under the lock the pushers notify under cannot miss a wakeup.
+		std::unique_lock l(sleep_lock);
+		++sleepers;
+		wake.wait(l, stop, [this, seen] { return pushes.load() != seen; });
+		--sleepers;
+	}
+}
+
+void thread_pool::push(unsigned self, task t) {
+	{
+		std::lock_guard l(queues[self].lock);
+		queues[self].tasks.push_back(t);
+	}
+
+	++pushes;
+	if (sleepers.load() != 0) {
+		std::lock_guard l(sleep_lock);
+		wake.notify_all();
+	}
+}
+
+std::optional<thread_pool::task> thread_pool::pop(unsigned self) {
+	auto& q = queues[self];
+	std::lock_guard l(q.lock);
+	if (q.tasks.empty())
+		return std::nullopt;
+
+	auto const t = q.tasks.back();
+	q.tasks.pop_back();
+	return t;
+}
+
+std::optional<thread_pool::task> thread_pool::steal(unsigned self) {
+	for (unsigned k = 1; k < queues.size(); ++k) {
+		auto& q = queues[(self + k) % queues.size()];
+		std::lock_guard l(q.lock);
+		if (q.tasks.empty())
+			continue;
+
+		auto const t = q.tasks.front();
+		q.tasks.pop_front();
+		return t;
+	}
+	return std::nullopt;
+}
+
+void thread_pool::execute(task t, unsigned self) {
+	auto& node = *t.node;
+	// A node run on its own may be gone as soon as remaining hits zero,
+	// so nothing of it is read after that.
+	auto* const graph = node.graph;
+
+	// Keep the lower half and offer the upper one to thieves, until what
+	// is left is no bigger than the grain.
+	while (t.last - t.first > node.grain) {
+		auto const middle = t.first + (t.last - t.first) / 2;
+		push(self, { t.node, middle, t.last });
+		t.last = middle;
+	}
+
+	node.body(t.first, t.last);
+
+	auto const done = t.last - t.first;
+	if (node.remaining.fetch_sub(done, std::memory_order_acq_rel) == done and graph != nullptr)
+		finish(node, self);
+}
+
+void thread_pool::schedule(task_graph::node_state& node, unsigned self) {
+	if (node.count == 0)
+		finish(node, self);
+	else
+		push(self, { &node, 0, node.count });
+}
+
+void thread_pool::finish(task_graph::node_state& node, unsigned self) {
+	auto* const graph = node.graph;
+	for (auto const next : node.successors) {
+		auto& successor = *graph->nodes[next];
+		if (successor.waiting.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			schedule(successor, self);
+	}
+
+	// Successors are queued before this can reach zero, so the caller never
+	// returns with work still pending.
+	graph->unfinished.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void thread_pool::run_alone(task_graph::node_state& state) {
+	participant const me(*this);
+
+	state.remaining.store(state.count, std::memory_order_relaxed);
+	push(me.index, { &state, 0, state.count });
+	help_until(me.index, [&state] { return state.remaining.load(std::memory_order_acquire) == 0; });
+}
+
+void thread_pool::run(task_graph& graph) {
+	if (graph.nodes.empty())
+		return;
+
+	participant const me(*this);
+
+	for (auto& node : graph.nodes) {
+		node->waiting.store(node->predecessors, std::memory_order_relaxed);
+		node->remaining.store(node->count, std::memory_order_relaxed);
+	}
+	graph.unfinished.store(graph.nodes.size(), std::memory_order_release);
+
+	for (auto& node : graph.nodes) {
+		if (node->predecessors == 0)
+			schedule(*node, me.index);
+	}
+
+	help_until(me.index, [&graph] { return graph.unfinished.load(std::memory_order_acquire) == 0; });
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Parallel loops with dependencies between them. Each node runs f(i) for
+// every i in [0, count) and starts once all the nodes it comes after have
+// finished, so a pass can begin on the part of the data that is ready while
+// the rest of the previous pass is still running. Built once, run by
+// thread_pool::run().
+class task_graph {
+public:
+	using node = size_t;
+
+	task_graph() = default;
+	task_graph(task_graph const&) = delete;
+	task_graph& operator=(task_graph const&) = delete;
+
+	// f(i) for i in [0, count), in pieces of at least grain indices.
+	template<typename Function>
+	node add(size_t count, Function&& f, size_t grain = 1) {
+		auto state = std::make_unique<node_state>();
+		state->body = [f = std::forward<Function>(f)](size_t first, size_t last) {
+			for (auto i = first; i < last; ++i)
+				f(i);
+		};
+		state->count = count;
+		state->grain = grain == 0 ? 1 : grain;
+		state->graph = this;
+		nodes.push_back(std::move(state));
+		return nodes.size() - 1;
+	}
+
+	// after starts only once before has finished.
+	void precede(node before, node after) {
+		nodes[before]->successors.push_back(after);
+		++nodes[after]->predecessors;
+	}
+
+	size_t size() const noexcept {
+		return nodes.size();
+	}
+
+	void clear() noexcept {
+		nodes.clear();
+	}
+
+private:
+	friend class thread_pool;
+
+	struct node_state {
+		std::function<void(size_t, size_t)> body;
+		size_t count = 0;
+		size_t grain = 1;
+		task_graph* graph = nullptr;
+		std::vector<node> successors;
+		size_t predecessors = 0;
+
+		// Predecessors still running, and indices not yet done, while the
+		// graph runs.
+		std::atomic<size_t> waiting = 0;
+		std::atomic<size_t> remaining = 0;
+	};
+
+	std::vector<std::unique_ptr<node_state>> nodes;
+	std::atomic<size_t> unfinished = 0;
+};
+
+// A work-stealing pool. Every participating thread, the caller of a
+// parallel call included, has its own queue of index ranges. A thread works
+// on its newest range, splitting it in halves down to the grain and leaving
+// the upper halves queued, and when it runs dry it steals the oldest, and so
+// largest, range of another thread. Uneven work, like Barnes-Hut walks or
+// tiles of different sizes, spreads itself out without any tuning.
+//
+// Calls block until their work is done, helping with it meanwhile, so they
+// nest: a task may start a parallel loop of its own. Only one thread from
+// outside the pool may call into it at a time; others wait their turn. The
+// functions given must not throw.
+class thread_pool {
+public:
+	struct options {
+		// Threads taking part in a call, the calling one included. 0 means
+		// one per hardware thread, 1 runs everything on the caller.
+		unsigned threads = 0;
+
+		// Pins worker k to core k, counting from 1 so core 0 is left to the
+		// thread calling in. Only on Linux and Windows.
+		bool pin = false;
+	};
+
+	thread_pool();
+	explicit thread_pool(options const& settings);
+	~thread_pool();
+
+	thread_pool(thread_pool const&) = delete;
+	thread_pool& operator=(thread_pool const&) = delete;
+
+	// Threads taking part in a call.
+	unsigned size() const noexcept {
+		return static_cast<unsigned>(queues.size());
+	}
+
+	// f(i) for every i in [first, last). Grain 0 picks one that gives each
+	// thread several pieces to balance with.
+	template<typename Function>
+	void for_each(size_t first, size_t last, Function&& f, size_t grain = 0) {
+		if (last <= first)
+			return;
+
+		task_graph::node_state state;
+		state.body = [&f, first](size_t a, size_t b) {
+			for (auto i = a; i < b; ++i)
+				f(first + i);
+		};
+		state.count = last - first;
+		state.grain = grain != 0 ? grain : std::max<size_t>(1, state.count / (8 * size()));
+		run_alone(state);
+	}
+
+	// f(element) for every element of a random access range, like
+	// index_range, pair_tiles or a span.
+	template<typename Range, typename Function>
+	void for_each(Range const& range, Function&& f, size_t grain = 0) {
+		auto const begin = range.begin();
+		for_each(size_t(0), static_cast<size_t>(range.end() - begin), [&f, &begin](size_t k) { f(begin[k]); }, grain);
+	}
+
+	void run(task_graph& graph);
+
+private:
+	struct task {
+		task_graph::node_state* node;
+		size_t first;
+		size_t last;
+	};
+
+	struct alignas(64) queue {
+		std::mutex lock;
+		std::deque<task> tasks;
+	};
+
+	void loop(std::stop_token stop, unsigned self);
+
+	void run_alone(task_graph::node_state& state);
+
+	// Index of the calling thread's queue, taking the outside caller's
+	// queue (and its lock) if the thread is not in the pool.
+	class participant;
+
+	void push(unsigned self, task t);
+	std::optional<task> pop(unsigned self);
+	std::optional<task> steal(unsigned self);
+
+	void execute(task t, unsigned self);
+	void schedule(task_graph::node_state& node, unsigned self);
+	void finish(task_graph::node_state& node, unsigned self);
+
+	// Runs tasks until done() holds.
+	template<typename Done>
+	void help_until(unsigned self, Done&& done) {
+		while (!done()) {
+			if (auto t = pop(self); t or (t = steal(self)))
+				execute(*t, self);
+			else
+				std::this_thread::yield();
+		}
+	}
+
+	std::vector<queue> queues;
+
+	std::mutex caller_lock;
+	std::mutex sleep_lock;
+	std::condition_variable_any wake;
+	std::atomic<uint64_t> pushes = 0;
+	std::atomic<unsigned> sleepers = 0;
+
+	std::vector<std::jthread> workers;
+};
@@ -0,0 +1,485 @@
+#include "trajectory.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+
+#include <fmt/format.h>
+
+#if defined(PHYSICS_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace {
+
+	// Columns per frame: x, y, vx, vy.
+	constexpr size_t frame_columns = 4;
+
+	bool seek_to(std::FILE* file, uint64_t offset) {
+#if defined(_WIN32)
+		return _fseeki64(file, static_cast<long long>(offset), SEEK_SET) == 0;
+#else
+		return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+	}
+
+	bool read_exactly(std::FILE* file, void* bytes, size_t count) {
+		return std::fread(bytes, 1, count, file) == count;
+	}
+
+	uint64_t largest_quantum(uint32_t bits) noexcept {
+		return bits >= 32 ? std::numeric_limits<uint32_t>::max() : (uint64_t(1) << bits) - 1;
+	}
+
+	uint32_t zigzag(uint32_t difference) noexcept {
+		auto const d = static_cast<int32_t>(difference);
+		return (static_cast<uint32_t>(d) << 1) ^ static_cast<uint32_t>(d >> 31);
+	}
+
+	uint32_t unzigzag(uint32_t z) noexcept {
+		return (z >> 1) ^ (0u - (z & 1u));
+	}
+
+	// Splits n values into four planes of n bytes, lowest byte first, and
+	// back.
+	void split_planes(uint32_t const* values, size_t n, unsigned char* planes) {
+		for (size_t b = 0; b < 4; ++b) {
+			auto* const plane = planes + b * n;
+			for (size_t i = 0; i < n; ++i)
+				plane[i] = static_cast<unsigned char>(values[i] >> (8 * b));
+		}
+	}
+
+	void join_planes(unsigned char const* planes, size_t n, uint32_t* values) {
+		for (size_t i = 0; i < n; ++i) {
+			values[i] = uint32_t(planes[i])
+				| uint32_t(planes[n + i]) << 8
+				| uint32_t(planes[2 * n + i]) << 16
+				| uint32_t(planes[3 * n + i]) << 24;
+		}
+	}
+
+}
+
+bool trajectory_codec_available(trajectory_format::codec c) noexcept {
+	switch (c) {
+	case trajectory_format::codec::raw:
+		return true;
+	case trajectory_format::codec::zlib:
+#if defined(PHYSICS_HAVE_ZLIB)
+		return true;
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+trajectory_writer::trajectory_writer() = default;
+
+trajectory_writer::~trajectory_writer() {
+	close();
+}
+
+bool trajectory_writer::open(std::string const& path, options const& new_options) {
+	close();
+
+	opts = new_options;
+	opts.every = std::max<uint64_t>(1, opts.every);
+	opts.frames_per_chunk = std::max<uint32_t>(1, opts.frames_per_chunk);
+	opts.position_bits = std::clamp<uint32_t>(opts.position_bits, 1, 32);
+	opts.max_pending_chunks = std::max<size_t>(1, opts.max_pending_chunks);
+	if (!trajectory_codec_available(opts.codec)) {
+		fmt::print(stderr, "Built without zlib, writing {} uncompressed\n", path);
+		opts.codec = trajectory_format::codec::raw;
+	}
+
+	file.reset(std::fopen(path.c_str(), "wb"));
+	if (!file) {
+		fmt::print(stderr, "Could not open {} for writing\n", path);
+		return false;
+	}
+
+	trajectory_format::header h;
+	std::memset(&h, 0, sizeof(h));
+	std::memcpy(h.magic, trajectory_format::magic, sizeof(h.magic));
+	h.version = trajectory_format::version;
+	h.byte_order = trajectory_format::byte_order_mark;
+	h.position_bits = opts.position_bits;
+	h.frames_per_chunk = opts.frames_per_chunk;
+	h.every = opts.every;
+
+	if (std::fwrite(&h, sizeof(h), 1, file.get()) != 1) {
+		fmt::print(stderr, "Could not write to {}\n", path);
+		file.reset();
+		return false;
+	}
+
+	frame_count = 0;
+	filling = chunk{};
+	queue.clear();
+	failed = false;
+	index.clear();
+	file_offset = sizeof(h);
+
+	worker = std::jthread([this](std::stop_token stop) { loop(stop); });
+	return true;
+}
+
+void trajectory_writer::record(simulation const& sim) {
+	if (!file)
+		return;
+
+	auto const step = sim.get_step_count();
+	if (step % opts.every != 0)
+		return;
+
+	auto const& manager = sim.manager;
+	auto const n = manager.size();
+
+	if (!filling.steps.empty() and filling.particle_count != n)
+		submit_chunk();
+
+	if (filling.steps.empty()) {
+		filling.particle_count = n;
+		filling.values.reserve(opts.frames_per_chunk * frame_columns * n);
+	}
+
+	for (auto const column : { manager.get_storage_for_component<PositionX>(), manager.get_storage_for_component<PositionY>(),
+		manager.get_storage_for_component<VelocityX>(), manager.get_storage_for_component<VelocityY>() })
+		filling.values.insert(filling.values.end(), column.begin(), column.end());
+
+	filling.steps.push_back(step);
+	++frame_count;
+
+	if (filling.steps.size() == opts.frames_per_chunk)
+		submit_chunk();
+}
+
+void trajectory_writer::submit_chunk() {
+	std::unique_lock l(lock);
+	queue_changed.wait(l, [this] { return queue.size() < opts.max_pending_chunks; });
+
+	queue.push_back(std::move(filling));
+	if (spare.empty()) {
+		filling = chunk{};
+	}
+	else {
+		filling = std::move(spare.back());
+		spare.pop_back();
+		filling.steps.clear();
+		filling.values.clear();
+	}
+
+	queue_changed.notify_all();
+}
+
+bool trajectory_writer::close() {
+	if (!file)
+		return true;
+
+	if (!filling.steps.empty())
+		submit_chunk();
+
+	// The writer thread drains the queue before it honours the stop.
+	worker.request_stop();
+	worker.join();
+	worker = std::jthread();
+
+	trajectory_format::trailer t;
+	std::memset(&t, 0, sizeof(t));
+	t.index_offset = file_offset;
+	t.frame_count = index.size();
+	std::memcpy(t.magic, trajectory_format::trailer_magic, sizeof(t.magic));
+
+	bool ok = !failed
+		and std::fwrite(index.data(), sizeof(trajectory_format::index_entry), index.size(), file.get()) == index.size()
+		and std::fwrite(&t, sizeof(t), 1, file.get()) == 1
+		and std::fflush(file.get()) == 0;
+
+	if (!ok)
+		fmt::print(stderr, "Failed writing trajectory\n");
+
+	file.reset();
+	spare.clear();
+	return ok;
+}
+
+void trajectory_writer::loop(std::stop_token stop) {
+	encode_buffers buffers;
+	std::unique_lock l(lock);
+
+	while (true) {
+		queue_changed.wait(l, stop, [this] { return !queue.empty(); });
+		if (queue.empty())
+			return;
+
+		auto c = std::move(queue.front());
+		queue.pop_front();
+		queue_changed.notify_all();
+
+		l.unlock();
+		auto const ok = write_chunk(c, buffers);
+		l.lock();
+
+		failed = failed or !ok;
+		spare.push_back(std::move(c));
+	}
+}
+
+bool trajectory_writer::write_chunk(chunk const& c, encode_buffers& buffers) {
+	auto const n = c.particle_count;
+	auto const frames = c.steps.size();
+	auto const frame_size = frame_columns * n;
+
+	trajectory_format::chunk_header h;
+	std::memset(&h, 0, sizeof(h));
+	h.frame_count = static_cast<uint32_t>(frames);
+	h.particle_count = n;
+
+	// Quantize positions over the chunk's box unless one was given.
+	h.min_x = opts.min_x;
+	h.min_y = opts.min_y;
+	h.max_x = opts.max_x;
+	h.max_y = opts.max_y;
+	if (!(h.min_x < h.max_x and h.min_y < h.max_y)) {
+		h.min_x = h.min_y = std::numeric_limits<float>::max();
+		h.max_x = h.max_y = std::numeric_limits<float>::lowest();
+		for (size_t f = 0; f < frames; ++f) {
+			auto const* const x = c.values.data() + f * frame_size;
+			auto const* const y = x + n;
+			for (size_t i = 0; i < n; ++i) {
+				h.min_x = std::min(h.min_x, x[i]);
+				h.max_x = std::max(h.max_x, x[i]);
+				h.min_y = std::min(h.min_y, y[i]);
+				h.max_y = std::max(h.max_y, y[i]);
+			}
+		}
+		if (!(h.min_x <= h.max_x and h.min_y <= h.max_y))
+			h.min_x = h.min_y = h.max_x = h.max_y = 0.f;
+		h.max_x = std::max(h.max_x, std::nextafter(h.min_x, std::numeric_limits<float>::max()));
+		h.max_y = std::max(h.max_y, std::nextafter(h.min_y, std::numeric_limits<float>::max()));
+	}
+
+	auto const top = static_cast<double>(largest_quantum(opts.position_bits));
+	auto const quantize = [top](float v, float low, float high) {
+		auto const t = (static_cast<double>(v) - low) / (static_cast<double>(high) - low) * top;
+		return !(t > 0.0) ? 0u : static_cast<uint32_t>(std::min(top, std::round(t)));
+	};
+
+	auto& values = buffers.values;
+	values.resize(frames * frame_size);
+	for (size_t f = 0; f < frames; ++f) {
+		auto const* const source = c.values.data() + f * frame_size;
+		auto* const target = values.data() + f * frame_size;
+		for (size_t i = 0; i < n; ++i) {
+			target[i] = quantize(source[i], h.min_x, h.max_x);
+			target[n + i] = quantize(source[n + i], h.min_y, h.max_y);
+			target[2 * n + i] = std::bit_cast<uint32_t>(source[2 * n + i]);
+			target[3 * n + i] = std::bit_cast<uint32_t>(source[3 * n + i]);
+		}
+	}
+
+	// Back to front, so every frame is diffed against the undiffed one
+	// before it.
+	for (size_t f = frames; f-- > 1;) {
+		auto* const current = values.data() + f * frame_size;
+		auto const* const previous = current - frame_size;
+		for (size_t i = 0; i < 2 * n; ++i)
+			current[i] = zigzag(current[i] - previous[i]);
+		for (size_t i = 2 * n; i < frame_size; ++i)
+			current[i] ^= previous[i];
+	}
+
+	auto& planes = buffers.planes;
+	planes.resize(values.size() * sizeof(uint32_t));
+	for (size_t column = 0; column < frames * frame_columns; ++column)
+		split_planes(values.data() + column * n, n, planes.data() + column * n * sizeof(uint32_t));
+
+	h.raw_size = planes.size();
+	h.codec = static_cast<uint32_t>(trajectory_format::codec::raw);
+
+	unsigned char const* payload = planes.data();
+	h.stored_size = planes.size();
+
+#if defined(PHYSICS_HAVE_ZLIB)
+	if (opts.codec == trajectory_format::codec::zlib) {
+		auto& stored = buffers.stored;
+		auto stored_size = compressBound(static_cast<uLong>(planes.size()));
+		stored.resize(stored_size);
+		if (compress2(stored.data(), &stored_size, planes.data(), static_cast<uLong>(planes.size()), opts.compression_level) != Z_OK)
+			return false;
+
+		h.codec = static_cast<uint32_t>(trajectory_format::codec::zlib);
+		payload = stored.data();
+		h.stored_size = stored_size;
+	}
+#endif
+
+	auto* const out = file.get();
+	auto const ok = std::fwrite(&h, sizeof(h), 1, out) == 1
+		and std::fwrite(c.steps.data(), sizeof(uint64_t), frames, out) == frames
+		and std::fwrite(payload, 1, h.stored_size, out) == h.stored_size;
+	if (!ok)
+		return false;
+
+	for (size_t f = 0; f < frames; ++f)
+		index.push_back({ c.steps[f], file_offset, static_cast<uint32_t>(f), 0 });
+	file_offset += sizeof(h) + frames * sizeof(uint64_t) + h.stored_size;
+
+	return true;
+}
+
+bool trajectory_reader::fail(std::string message) {
+	file.reset();
+	index.clear();
+	last_error = std::move(message);
+	return false;
+}
+
+bool trajectory_reader::open(std::string const& path) {
+	using namespace trajectory_format;
+
+	cached_offset = ~uint64_t(0);
+	index.clear();
+
+	std::error_code error;
+	auto const size = std::filesystem::file_size(path, error);
+	file.reset(std::fopen(path.c_str(), "rb"));
+	if (error or !file)
+		return fail("could not open " + path);
+
+	if (!read_exactly(file.get(), &file_header, sizeof(file_header)))
+		return fail(path + " is too short to be a trajectory");
+	if (std::memcmp(file_header.magic, magic, sizeof(magic)) != 0)
+		return fail(path + " is not a trajectory");
+	if (file_header.byte_order != byte_order_mark)
+		return fail(path + " was written with a different byte order");
+	if (file_header.version != version)
+		return fail(fmt::format("{} is trajectory version {}, expected {}", path, file_header.version, version));
+	if (file_header.position_bits < 1 or file_header.position_bits > 32)
+		return fail(path + " has an invalid position resolution");
+
+	trailer t;
+	if (size >= sizeof(file_header) + sizeof(t) and seek_to(file.get(), size - sizeof(t))
+		and read_exactly(file.get(), &t, sizeof(t))
+		and std::memcmp(t.magic, trailer_magic, sizeof(trailer_magic)) == 0
+		and t.index_offset + t.frame_count * sizeof(index_entry) + sizeof(t) == size) {
+		index.resize(t.frame_count);
+		if (!seek_to(file.get(), t.index_offset) or !read_exactly(file.get(), index.data(), index.size() * sizeof(index_entry)))
+			return fail(path + " has an unreadable index");
+	}
+	else {
+		// Never closed; rebuild the index from whichever chunks made it.
+		uint64_t offset = sizeof(file_header);
+		chunk_header h;
+		std::vector<uint64_t> steps;
+		while (seek_to(file.get(), offset) and read_exactly(file.get(), &h, sizeof(h))) {
+			auto const chunk_end = offset + sizeof(h) + h.frame_count * sizeof(uint64_t) + h.stored_size;
+			steps.resize(h.frame_count);
+			if (chunk_end > size or !read_exactly(file.get(), steps.data(), steps.size() * sizeof(uint64_t)))
+				break;
+			for (uint32_t f = 0; f < h.frame_count; ++f)
+				index.push_back({ steps[f], offset, f, 0 });
+			offset = chunk_end;
+		}
+	}
+
+	last_error.clear();
+	return true;
+}
+
+bool trajectory_reader::load_chunk(uint64_t offset) {
+	using namespace trajectory_format;
+
+	cached_offset = ~uint64_t(0);
+
+	auto& h = cached_header;
+	if (!seek_to(file.get(), offset) or !read_exactly(file.get(), &h, sizeof(h)))
+		return false;
+
+	auto const n = h.particle_count;
+	auto const frame_size = frame_columns * n;
+	if (h.raw_size != h.frame_count * frame_size * sizeof(uint32_t))
+		return false;
+
+	if (!seek_to(file.get(), offset + sizeof(h) + h.frame_count * sizeof(uint64_t)))
+		return false;
+
+	planes.resize(h.raw_size);
+	switch (static_cast<codec>(h.codec)) {
+	case codec::raw:
+		if (h.stored_size != h.raw_size or !read_exactly(file.get(), planes.data(), planes.size()))
+			return false;
+		break;
+	case codec::zlib: {
+#if defined(PHYSICS_HAVE_ZLIB)
+		stored.resize(h.stored_size);
+		if (!read_exactly(file.get(), stored.data(), stored.size()))
+			return false;
+		auto raw_size = static_cast<uLongf>(planes.size());
+		if (uncompress(planes.data(), &raw_size, stored.data(), static_cast<uLong>(stored.size())) != Z_OK or raw_size != planes.size())
+			return false;
+		break;
+#else
+		return false;
+#endif
+	}
+	default:
+		return false;
+	}
+
+	decoded.resize(h.frame_count * frame_size);
+	for (size_t column = 0; column < h.frame_count * frame_columns; ++column)
+		join_planes(planes.data() + column * n * sizeof(uint32_t), n, decoded.data() + column * n);
+
+	for (size_t f = 1; f < h.frame_count; ++f) {
+		auto* const current = decoded.data() + f * frame_size;
+		auto const* const previous = current - frame_size;
+		for (size_t i = 0; i < 2 * n; ++i)
+			current[i] = previous[i] + unzigzag(current[i]);
+		for (size_t i = 2 * n; i < frame_size; ++i)
+			current[i] ^= previous[i];
+	}
+
+	cached_offset = offset;
+	return true;
+}
+
+bool trajectory_reader::read_frame(size_t frame, std::vector<float>& x, std::vector<float>& y,
+	std::vector<float>& vx, std::vector<float>& vy) {
+	if (!file or frame >= index.size())
+		return false;
+
+	auto const& entry = index[frame];
+	if (cached_offset != entry.chunk_offset and !load_chunk(entry.chunk_offset)) {
+		last_error = fmt::format("chunk at {} is corrupt", entry.chunk_offset);
+		return false;
+	}
+
+	auto const& h = cached_header;
+	auto const n = h.particle_count;
+	if (entry.frame_in_chunk >= h.frame_count)
+		return false;
+
+	auto const* const values = decoded.data() + entry.frame_in_chunk * frame_columns * n;
+	auto const top = static_cast<double>(largest_quantum(file_header.position_bits));
+	auto const scale_x = (static_cast<double>(h.max_x) - h.min_x) / top;
+	auto const scale_y = (static_cast<double>(h.max_y) - h.min_y) / top;
+
+	x.resize(n);
+	y.resize(n);
+	vx.resize(n);
+	vy.resize(n);
+	for (size_t i = 0; i < n; ++i) {
+		x[i] = static_cast<float>(h.min_x + values[i] * scale_x);
+		y[i] = static_cast<float>(h.min_y + values[n + i] * scale_y);
+		vx[i] = std::bit_cast<float>(values[2 * n + i]);
+		vy[i] = std::bit_cast<float>(values[3 * n + i]);
+	}
+
+	return true;
+}
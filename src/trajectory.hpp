@@ -0,0 +1,224 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "simulation.hpp"
+
+// Trajectory file layout, all little endian:
+//
+//   trajectory_format::header
+//   chunks, each a trajectory_format::chunk_header, the frame steps
+//   (uint64 each) and the payload
+//   the frame index, one trajectory_format::index_entry per frame
+//   trajectory_format::trailer
+//
+// A chunk holds frames_per_chunk consecutive recorded frames of the same
+// particle count and decodes on its own. Its payload, before compression, is
+// per frame the x and y positions quantized to position_bits of fixed point
+// over the chunk's bounding box, then vx and vy as float bits. Every column
+// is stored as the difference to the same column of the previous frame in
+// the chunk (zigzagged integers for positions, XOR for velocities) and split
+// into byte planes, which leaves long runs of zero bytes for the compressor.
+//
+// The index lets a reader seek straight to any frame. If the trailer is
+// missing, because the writer never closed, the chunks can still be walked
+// from the front.
+namespace trajectory_format {
+	inline constexpr char magic[8] = { '2', 'D', 'P', 'H', 'Y', 'S', 'T', 'R' };
+	inline constexpr char trailer_magic[8] = { '2', 'D', 'P', 'H', 'T', 'R', 'I', 'X' };
+	inline constexpr uint32_t version = 1;
+	inline constexpr uint32_t byte_order_mark = 0x01020304;
+
+	enum class codec : uint32_t {
+		raw = 0,
+		zlib = 1
+	};
+
+	struct header {
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+		uint32_t position_bits;
+		uint32_t frames_per_chunk;
+		uint64_t every;
+	};
+
+	struct chunk_header {
+		uint32_t frame_count;
+		uint32_t codec;
+		uint64_t particle_count;
+		float min_x;
+		float min_y;
+		float max_x;
+		float max_y;
+		uint64_t raw_size;
+		uint64_t stored_size;
+	};
+
+	struct index_entry {
+		uint64_t step;
+		uint64_t chunk_offset;
+		uint32_t frame_in_chunk;
+		uint32_t reserved;
+	};
+
+	struct trailer {
+		uint64_t index_offset;
+		uint64_t frame_count;
+		char magic[8];
+	};
+
+	static_assert(sizeof(header) == 32);
+	static_assert(sizeof(chunk_header) == 48);
+	static_assert(sizeof(index_entry) == 24);
+	static_assert(sizeof(trailer) == 24);
+}
+
+// Codecs this build can write and read.
+bool trajectory_codec_available(trajectory_format::codec c) noexcept;
+
+// Records every Nth step's positions and velocities. The simulation thread
+// only copies the columns into a chunk buffer; quantizing, encoding,
+// compressing and writing happen on a background thread. If that thread
+// falls more than max_pending_chunks behind, record() waits for it rather
+// than dropping frames.
+class trajectory_writer {
+public:
+	struct options {
+		// Record steps that are a multiple of every.
+		uint64_t every = 10;
+		uint32_t frames_per_chunk = 32;
+		// Fixed point resolution of the positions, 1 to 32. The error is at
+		// most half a bounding box side over 2^position_bits - 1.
+		uint32_t position_bits = 20;
+		// Bounding box the positions are quantized over. If empty, each
+		// chunk uses the box of its own frames, which never clips.
+		float min_x = 0.f;
+		float min_y = 0.f;
+		float max_x = 0.f;
+		float max_y = 0.f;
+		// Falls back to raw if this build has no zlib.
+		trajectory_format::codec codec = trajectory_format::codec::zlib;
+		int compression_level = 1;
+		size_t max_pending_chunks = 4;
+	};
+
+	trajectory_writer();
+	~trajectory_writer();
+
+	trajectory_writer(trajectory_writer const&) = delete;
+	trajectory_writer& operator=(trajectory_writer const&) = delete;
+
+	bool open(std::string const& path, options const& opts);
+
+	// Call after every step, from the thread that steps sim.
+	void record(simulation const& sim);
+
+	// Writes out the partial chunk and the index. Returns false if anything
+	// failed to write since open().
+	bool close();
+
+	bool is_open() const noexcept {
+		return file != nullptr;
+	}
+
+	uint64_t frames_recorded() const noexcept {
+		return frame_count;
+	}
+
+private:
+	struct chunk {
+		size_t particle_count = 0;
+		std::vector<uint64_t> steps;
+		// Frame after frame of x, y, vx, vy columns.
+		std::vector<float> values;
+	};
+
+	struct file_closer {
+		void operator()(std::FILE* f) const noexcept {
+			std::fclose(f);
+		}
+	};
+
+	// Scratch space of the writer thread, kept between chunks.
+	struct encode_buffers {
+		std::vector<uint32_t> values;
+		std::vector<unsigned char> planes;
+		std::vector<unsigned char> stored;
+	};
+
+	void submit_chunk();
+	void loop(std::stop_token stop);
+	bool write_chunk(chunk const& c, encode_buffers& buffers);
+
+	options opts;
+	std::unique_ptr<std::FILE, file_closer> file;
+	uint64_t frame_count = 0;
+
+	// Filled by record(), owned by the simulation thread.
+	chunk filling;
+
+	// Everything below is shared with the writer thread.
+	std::mutex lock;
+	std::condition_variable_any queue_changed;
+	std::deque<chunk> queue;
+	std::vector<chunk> spare;
+	bool failed = false;
+	std::vector<trajectory_format::index_entry> index;
+	uint64_t file_offset = 0;
+
+	std::jthread worker;
+};
+
+// Reads frames back out of a trajectory file in any order.
+class trajectory_reader {
+public:
+	bool open(std::string const& path);
+
+	std::string const& error() const noexcept {
+		return last_error;
+	}
+
+	size_t frame_count() const noexcept {
+		return index.size();
+	}
+
+	uint64_t step_of(size_t frame) const noexcept {
+		return index[frame].step;
+	}
+
+	// Decodes one frame into the vectors, resized to its particle count.
+	bool read_frame(size_t frame, std::vector<float>& x, std::vector<float>& y,
+		std::vector<float>& vx, std::vector<float>& vy);
+
+private:
+	bool fail(std::string message);
+	bool load_chunk(uint64_t offset);
+
+	struct file_closer {
+		void operator()(std::FILE* f) const noexcept {
+			std::fclose(f);
+		}
+	};
+
+	std::unique_ptr<std::FILE, file_closer> file;
+	trajectory_format::header file_header{};
+	std::vector<trajectory_format::index_entry> index;
+	std::string last_error;
+
+	// The most recently decoded chunk, so reading consecutive frames only
+	// decompresses each chunk once.
+	uint64_t cached_offset = ~uint64_t(0);
+	trajectory_format::chunk_header cached_header{};
+	std::vector<uint32_t> decoded;
+	std::vector<unsigned char> planes;
+	std::vector<unsigned char> stored;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Single producer, single consumer hand-off of the latest value. The writer
+// fills back() and publishes it, the reader picks up the most recently
+// published value with update(); neither ever waits on the other, and
+// values the reader was too slow to see are simply overwritten.
+template<typename T>
+class triple_buffer {
+public:
+	triple_buffer() = default;
+	triple_buffer(triple_buffer const&) = delete;
+	triple_buffer& operator=(triple_buffer const&) = delete;
+
+	// Writer side.
+	T& back() noexcept {
+		return buffers[back_index];
+	}
+
+	void publish() noexcept {
+		back_index = middle.exchange(back_index | fresh_bit, std::memory_order_acq_rel) & index_mask;
+	}
+
+	// Reader side. Returns true if front() changed.
+	bool update() noexcept {
+		if ((middle.load(std::memory_order_relaxed) & fresh_bit) == 0)
+			return false;
+
+		front_index = middle.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+		return true;
+	}
+
+	T const& front() const noexcept {
+		return buffers[front_index];
+	}
+
+private:
+	static constexpr uint8_t index_mask = 0b011;
+	static constexpr uint8_t fresh_bit = 0b100;
+
+	std::array<T, 3> buffers;
+
+	// Each side's index lives on its own cache line, away from the shared
+	// middle slot.
+	alignas(64) std::atomic<uint8_t> middle{ 1 };
+	alignas(64) uint8_t back_index = 0;
+	alignas(64) uint8_t front_index = 2;
+};
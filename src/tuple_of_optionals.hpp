@@ -2,7 +2,7 @@
 
 #include <bitset>
 
-#include <fmt\format.h>
+#include <fmt/format.h>
 
 #include "TypeList.hpp"
 